@@ -1,413 +1,1986 @@
-// fragment shading of sphere model
-#include <GL/glew.h>
-#include <GL/freeglut.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <iostream>
-#include "math.h"
-#include "vec2.h"
-#include "mat2.h"
-
-const int NumTimesToSubdivide = 6; // number of subdivisions
-const int NumTriangles = 16384;	   // (4 faces)^(NumTimesToSubdivide + 1)
-const int NumVertices = 3 * NumTriangles;
-
-float dx = 0, dy = 0; 		// for light position change
-
-vec4 points[NumVertices]; // vertices of the triangles
-vec3 normals[NumVertices]; // normals of the triangles
-
-// Model-view and projection matrices uniform location
-GLuint ModelView, Projection;
-GLuint InitShader(const char *vShaderFile, const char *fShaderFile);
-static char *ReadShaderSource(const char *ShaderFile);
-//----------------------------------------------------------------------------
-
-int Index = 0;
-
-void triangle(const vec4 &a, const vec4 &b, const vec4 &c)
-{
-	vec3 normal = normalize(cross(b - a, c - b)); // normal vector of the triangle and for each vertex
-
-	// for each vertex of the triangle store the normal and the vertex in the points and normals array
-	normals[Index] = normal;
-	points[Index] = a;
-	Index++;
-	normals[Index] = normal;
-	points[Index] = b;
-	Index++;
-	normals[Index] = normal;
-	points[Index] = c;
-	Index++;
-}
-
-//----------------------------------------------------------------------------
-// normalize the vector and set the w component to 1
-vec4 unit(const vec4 &p)
-{
-	float len = p.x * p.x + p.y * p.y + p.z * p.z;
-
-	vec4 t;
-	if (len > 0.0000001)
-	{
-		t = p / sqrt(len);
-		t.w = 1.0;
-	}
-
-	return t;
-}
-
-// divide the triangle into 4 triangles and call the triangle function to store the vertices and normals
-void divide_triangle(const vec4 &a, const vec4 &b,
-					 const vec4 &c, int count)
-{
-	if (count > 0)
-	{
-		vec4 v1 = unit(a + b); // calculate the mid point of the edge and normalize it to project it on the sphere
-		vec4 v2 = unit(a + c);
-		vec4 v3 = unit(b + c);
-		divide_triangle(a, v1, v2, count - 1); // divide the triangle into 4 triangles
-		divide_triangle(c, v2, v3, count - 1);
-		divide_triangle(b, v3, v1, count - 1);
-		divide_triangle(v1, v3, v2, count - 1);
-	}
-	else
-	{
-		triangle(a, b, c);
-	}
-}
-
-// create a tetrahedron and divide it into a sphere
-void tetrahedron(int count)
-{
-	vec4 v[4];										   // vertices of the tetrahedron
-	v[0] = vec4(0.0, 0.0, 1.0, 1.0);				   // top vertex
-	v[1] = vec4(0.0, 0.942809, -0.333333, 1.0);		   // bottom vertex
-	v[2] = vec4(-0.816497, -0.471405, -0.333333, 1.0); // left vertex
-	v[3] = vec4(0.816497, -0.471405, -0.333333, 1.0);  // right vertex
-
-	// divide each face of the tetrahedron into 4 triangles and again divide each triangle into 4 triangles
-	// and project the vertices on the sphere
-	divide_triangle(v[0], v[1], v[2], count);
-	divide_triangle(v[3], v[2], v[1], count);
-	divide_triangle(v[0], v[3], v[1], count);
-	divide_triangle(v[0], v[2], v[3], count);
-}
-
-//----------------------------------------------------------------------------
-
-// OpenGL initialization
-mat4 model_view;
-vec4 light_position(2.0 + dx, 2.0 + dy, 0.5, 0.0); // directional light source
-bool isdirectional = true;						   // light type
-
-// Initialize shader lighting parameters
-vec4 light_ambient(0.2, 0.2, 0.2, 1.0);
-vec4 light_diffuse(1.0, 1.0, 1.0, 1.0);
-vec4 light_specular(1.0, 1.0, 1.0, 1.0);
-
-vec4 material_ambient(0.2, 0.2, 0.2, 1.0);
-vec4 material_diffuse(0.8, 0.8, 0.8, 1.0); // Neutral color
-vec4 material_specular(1.0, 1.0, 1.0, 1.0);
-float material_shininess = 15;
-
-GLuint program;
-void init()
-{
-	// Subdivide a tetrahedron into a sphere
-	tetrahedron(NumTimesToSubdivide);
-
-	// Create and initialize a buffer object
-	GLuint buffer;
-	glGenBuffers(1, &buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(points) + sizeof(normals),
-				 NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(points), points);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(points),
-					sizeof(normals), normals);
-
-	// Load shaders and use the resulting shader program
-	program = InitShader("vshader.glsl", "fshader.glsl");
-	glUseProgram(program);
-
-	// set up vertex arrays
-	GLuint vPosition = glGetAttribLocation(program, "vPosition");
-	glEnableVertexAttribArray(vPosition);
-	glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, 0);
-
-	GLuint vNormal = glGetAttribLocation(program, "vNormal");
-	glEnableVertexAttribArray(vNormal);
-	glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0,
-						  (const GLvoid *)sizeof(points));
-
-	vec4 ambient_product = light_ambient * material_ambient;
-	vec4 diffuse_product = light_diffuse * material_diffuse;
-	vec4 specular_product = light_specular * material_specular;
-
-	// Set up uniform variables
-	glUniform4fv(glGetUniformLocation(program, "AmbientProduct"),
-				 1, ambient_product);
-	glUniform4fv(glGetUniformLocation(program, "DiffuseProduct"),
-				 1, diffuse_product);
-	glUniform4fv(glGetUniformLocation(program, "SpecularProduct"),
-				 1, specular_product);
-
-	glUniform4fv(glGetUniformLocation(program, "LightPosition"),
-				 1, light_position);
-
-	glUniform1f(glGetUniformLocation(program, "Shininess"),
-				material_shininess);
-
-	// Retrieve transformation uniform variable locations
-	ModelView = glGetUniformLocation(program, "ModelView");
-	Projection = glGetUniformLocation(program, "Projection");
-
-	glEnable(GL_DEPTH_TEST);
-	glClearColor(1.0, 1.0, 1.0, 1.0); /* white background */
-}
-
-//----------------------------------------------------------------------------
-
-void display(void)
-{
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	vec4 at(0.0, 0.0, 0.0, 1.0);		   // set up the object at the origin
-	vec4 eye(0.0, 0.0, 2.0, 1.0);		   // set up the camera
-	vec4 up(0.0, 1.0, 0.0, 0.0);		   // set up the up vector
-	mat4 model_view = LookAt(eye, at, up); // set up the model-view matrix
-
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view); // set up the model-view matrix
-
-	glUniform4fv(glGetUniformLocation(program, "LightPosition"),
-				 1, light_position); // set up the light position in the shader if the light is changed
-
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices); // draw the sphere
-	glutSwapBuffers();							// swap the buffers
-}
-
-//----------------------------------------------------------------------------
-
-// light color function
-void setLightColor(float r, float g, float b)
-{
-	light_diffuse = vec4(r, g, b, 1.0); // set up the diffuse light color and change the sphere color
-	vec4 diffuse_product = light_diffuse * material_diffuse;
-	glUniform4fv(glGetUniformLocation(program, "DiffuseProduct"),
-				 1, diffuse_product); // set up the diffuse product in the shader
-
-	glutPostRedisplay(); // redraw the sphere
-}
-
-//----------------------------------------------------------------------------
-// color menu function
-void colorMenu(int id)
-{
-	switch (id)
-	{
-	case 1:
-		setLightColor(1.0, 0.0, 0.0); // Red
-		break;
-	case 2:
-		setLightColor(0.0, 1.0, 0.0); // Green
-		break;
-	case 3:
-		setLightColor(0.0, 0.0, 1.0); // Blue
-		break;
-	case 4:
-		setLightColor(1.0, 1.0, 1.0); // White
-		break;
-	case 5:
-		setLightColor(1.0, 1.0, 0.0); // Yellow
-		break;
-	case 6:
-		setLightColor(1.0, 0.0, 1.0); // Magenta
-		break;
-	case 7:
-		setLightColor(0.0, 1.0, 1.0); // Cyan
-		break;
-	}
-}
-// create the menu
-void createMenu()
-{
-	glutCreateMenu(colorMenu);
-	glutAddMenuEntry("Red", 1);
-	glutAddMenuEntry("Green", 2);
-	glutAddMenuEntry("Blue", 3);
-	glutAddMenuEntry("White", 4);
-	glutAddMenuEntry("Yellow", 5);
-	glutAddMenuEntry("Magenta", 6);
-	glutAddMenuEntry("Cyan", 7);
-	glutAttachMenu(GLUT_RIGHT_BUTTON);
-}
-
-//----------------------------------------------------------------------------
-
-void keyboard(unsigned char key, int x, int y)
-{
-	switch (key)
-	{
-	case 033: // Escape Key
-	case 'r':
-		dx += 0.1; // move the light source in the x direction
-		break;
-	case 'l':
-		dx -= 0.1; // move the light source in the -x direction
-		break;
-	case 'u':
-		dy += 0.1; // move the light source in the y direction
-		break;
-	case 'd':
-		dy -= 0.1; // move the light source in the -y direction
-		break;
-	case 'q':
-	case 'Q':
-		exit(EXIT_SUCCESS);
-		break;
-	// toggle light type(directional or point)
-	case 't':
-		isdirectional = !isdirectional; // change the light type
-		break;
-	}
-	// set the light position and change the light type with the keyboard input
-	light_position = vec4(2.0 + dx, 2.0 + dy, 2.0, isdirectional ? 0.0 : 1.0);
-	glutPostRedisplay();
-}
-
-//----------------------------------------------------------------------------
-// reshape function to set up the projection matrix and the viewport matrix when the window size is changed
-void reshape(int width, int height)
-{
-	glViewport(0, 0, width, height);
-
-	GLfloat left = -2.0, right = 2.0;
-	GLfloat top = 2.0, bottom = -2.0;
-	GLfloat zNear = -2.0, zFar = 2.0;
-	GLfloat aspect = GLfloat(width) / height; // set up the aspect ratio of the window size to keep the sphere in the correct shape
-
-	if (aspect > 1.0)
-	{
-		left *= aspect;
-		right *= aspect;
-	}
-	else
-	{
-		top /= aspect;
-		bottom /= aspect;
-	}
-	// set up the projection matrix and send it to the shader
-	mat4 projection = Ortho(left, right, bottom, top, zNear, zFar); // Orthographic projection
-	glUniformMatrix4fv(Projection, 1, GL_TRUE, projection);			// set up the projection matrix in the shader
-}
-
-//----------------------------------------------------------------------------
-
-int main(int argc, char **argv)
-{
-
-	glutInit(&argc, argv);									   // initialize the glut
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH); // set up the display mode
-	glutInitWindowSize(512, 512);							   // set up the window size
-	glutInitWindowPosition(0, 0);							   // set up the window position
-	glutCreateWindow("Project_Erfan_GhaziAsgar");			   // create the window
-	glewInit();												   // initialize the glew
-	init();													   // initialize the program
-	glutDisplayFunc(display);								   // set up the display function
-	glutReshapeFunc(reshape);								   // set up the reshape function
-	glutKeyboardFunc(keyboard);								   // set up the keyboard function
-	createMenu();											   // create the menu
-	glutMainLoop();											   // run the main loop
-}
-
-//----------------------------------------------------------------------------
-// Shader
-GLuint InitShader(const char *vShaderFile, const char *fShaderFile)
-{
-	char *svs, *sfs;
-	GLuint program, VertexShader, FragmentShader;
-
-	program = glCreateProgram();
-	VertexShader = glCreateShader(GL_VERTEX_SHADER);
-	svs = ReadShaderSource(vShaderFile);
-	// printf("\n %s", svs);
-	glShaderSource(VertexShader, 1, (const GLchar **)&svs, NULL);
-	glCompileShader(VertexShader);
-	glAttachShader(program, VertexShader);
-
-	GLint compiled;
-	glGetShaderiv(VertexShader, GL_COMPILE_STATUS, &compiled);
-	if (!compiled)
-	{
-		printf("/n failed to compile");
-		GLint logSize;
-		glGetShaderiv(VertexShader, GL_INFO_LOG_LENGTH, &logSize);
-		char *logMsg = new char[logSize];
-		glGetShaderInfoLog(VertexShader, logSize, NULL, logMsg);
-		printf("\n  %s", logMsg);
-		getchar();
-		// delete[] logMsg;
-		exit(EXIT_FAILURE);
-	}
-
-	FragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	sfs = ReadShaderSource(fShaderFile);
-	// printf("\n  %s", sfs);
-	glShaderSource(FragmentShader, 1, (const GLchar **)&sfs, NULL);
-	glCompileShader(FragmentShader);
-
-	glGetShaderiv(FragmentShader, GL_COMPILE_STATUS, &compiled);
-	if (!compiled)
-	{
-		printf("\n failed to compile");
-		GLint logSize2;
-		glGetShaderiv(FragmentShader, GL_INFO_LOG_LENGTH, &logSize2);
-		char logMsg2[161]; // = new char[162];//logSize2];
-		glGetShaderInfoLog(FragmentShader, logSize2, NULL, logMsg2);
-		printf("\n  %s", logMsg2);
-		getchar();
-		// delete[] logMsg2;
-		exit(EXIT_FAILURE);
-	}
-
-	glAttachShader(program, FragmentShader);
-	glLinkProgram(program);
-
-	GLint linked;
-	glGetProgramiv(program, GL_LINK_STATUS, &linked);
-	if (!linked)
-	{
-		printf("/n failed to link");
-		GLint logSize;
-		glGetShaderiv(VertexShader, GL_INFO_LOG_LENGTH, &logSize);
-		char *logMsg = new char[logSize];
-		glGetProgramInfoLog(program, logSize, NULL, logMsg);
-		printf("\n  %s", logMsg);
-		// delete[] logMsg;
-		exit(EXIT_FAILURE);
-	}
-
-	glUseProgram(program);
-	return program;
-}
-static char *ReadShaderSource(const char *ShaderFile)
-{
-	FILE *fp;
-	fp = fopen(ShaderFile, "rt");
-	if (!fp)
-		return NULL;
-	long size = 0;
-	while (!feof(fp))
-	{
-		fgetc(fp);
-		size++;
-	}
-	size--;
-	fseek(fp, 0, SEEK_SET);
-	char *buf = new char[size + 1];
-	fread(buf, 1, size, fp);
-	buf[size] = 0;
-	fclose(fp);
-	return buf;
-}
+// fragment shading of sphere model
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include "math.h"
+#include "vec2.h"
+#include "mat2.h"
+#include "sphere.h"
+#include "meshcache.h"
+#include "shadercache.h"
+#include "glstate.h"
+#include "lighting.h"
+#include "tiledlights.h"
+#include "bakedlighting.h"
+#include "shadervariant.h"
+#include "shaderwatch.h"
+#include "vertexformat.h"
+#include "instances.h"
+#include "culling.h"
+#include "occlusion.h"
+#include "renderqueue.h"
+#include "startup.h"
+
+int NumTimesToSubdivide = 6;		// number of subdivisions, set with -level or the +/- keys
+int NumThreads = hardwareThreads(); // threads used for the subdivision, set with -threads
+
+float dx = 0, dy = 0; 		// for light position change
+
+// Model-view and projection matrices uniform location
+GLuint ModelView, Projection;
+GLuint InitShader(const char *vShaderFile, const char *fShaderFile, const char *defines = "", bool *fromCache = NULL);
+static GLuint buildProgram(const std::string &vs, const std::string &fs, const char *defines, bool retrievable);
+static bool programBuilt(GLuint program);
+static bool programLinked(GLuint program, std::string &log);
+static bool programCachePath(const std::string &vs, const std::string &fs, const char *defines, std::string &path,
+							 uint64_t &key);
+void useVariant(const ShaderVariant &v);
+bool parallelShaderCompile = false; // GL_KHR_parallel_shader_compile: programs build while we go on
+//----------------------------------------------------------------------------
+
+// OpenGL initialization
+vec4 at(0.0, 0.0, 0.0, 1.0);			// set up the object at the origin
+vec4 eye(0.0, 0.0, 2.0, 1.0);			// set up the camera
+vec4 up(0.0, 1.0, 0.0, 0.0);			// set up the up vector
+mat4 model_view = LookAt(eye, at, up);	// set up the model-view matrix
+mat4 projection;						// set up in reshape()
+int windowWidth = 512, windowHeight = 512; // viewport size in pixels
+vec4 light_position(2.0 + dx, 2.0 + dy, 0.5, 0.0); // directional light source
+bool isdirectional = true;						   // light type
+
+// Initialize shader lighting parameters
+vec4 light_ambient(0.2, 0.2, 0.2, 1.0);
+vec4 light_diffuse(1.0, 1.0, 1.0, 1.0);
+vec4 light_specular(1.0, 1.0, 1.0, 1.0);
+
+vec4 material_ambient(0.2, 0.2, 0.2, 1.0);
+vec4 material_diffuse(0.8, 0.8, 0.8, 1.0); // Neutral color
+vec4 material_specular(1.0, 1.0, 1.0, 1.0);
+float material_shininess = 15;
+
+GLuint program; // of the current shader variant
+
+// every shader variant is compiled on its first use and kept; all of them have the same attribute locations,
+// and their uniform locations are looked up once, after linking
+struct VariantProgram
+{
+	GLuint program; // 0 until compiled
+	GLint modelView, projection, octahedralNormals;
+	GLint tiledLights, lightTiles, lightEntries; // samplers of the tiled lights
+	GLint baking;
+};
+VariantProgram variantPrograms[ShaderVariants];
+// set with -point, -nospecular, -lights, -pointlights, -baked or the t, s, n and b keys
+ShaderVariant shaderVariant = {true, true, 1, false, false, false};
+bool benchmarkShaders = false;				   // set with -shaderbench
+GLuint vPosition = 0, vNormal = 1; // vertex attribute locations, bound before linking
+
+// sphere buffers: the triangle soup and the indexed mesh can both be drawn to compare them
+IndexedSphere sphere; // every level of the indexed sphere built so far
+GLuint soupBuffer;
+GLuint indexedBuffers[2]; // vertices of the indexed sphere; the second one only with the streams layout
+GLuint indexedElements; // index lists of every uploaded level, back to back
+
+// where the indices of one level lie in the element buffer
+struct LodRange
+{
+	GLintptr offset; // in bytes
+	GLsizei count;
+};
+LodRange lodRanges[MaxTimesToSubdivide + 1];
+// meshlets of every uploaded level back to back, and where those of each level lie
+std::vector<Meshlet> meshlets;
+struct MeshletRange
+{
+	size_t first, count;
+} meshletRanges[MaxTimesToSubdivide + 1];
+bool meshletCulling = false; // draw only the meshlets in view facing the eye, set with -meshlets or the m key
+std::vector<GLsizei> drawCounts; // index ranges of the meshlets that survived culling
+std::vector<const GLvoid *> drawOffsets;
+bool autoLod = false; // pick the drawn level from the projected radius instead of NumTimesToSubdivide
+GLsizei soupCount;		 // vertices of the triangle soup
+GLsizei indexedVertices; // vertices in the indexed sphere buffer
+GLenum indexedType;
+VertexFormat indexedFormat = FloatVertices;			// how the indexed sphere vertices are stored, set with -format
+VertexLayoutKind indexedLayoutKind = SplitLayout; // how they are laid out in the buffers, set with -layout
+GLint OctahedralNormals;					// uniform location
+unsigned sphereUploads = 0;				// times the sphere buffers were filled, for telling bakes are stale
+int soupLevel = -1, indexedLevel = -1; // subdivision level each buffer currently holds / is drawn
+int uploadedLevel = -1;					// finest indexed level in indexedBuffers and indexedElements
+SphereRefiner refiner;					// refines the indexed sphere in the background
+// how the sphere is drawn
+enum SphereMode
+{
+	IndexedMode,  // indexed mesh with glDrawElements
+	SoupMode,	  // triangle soup with glDrawArrays
+	AdaptiveMode, // triangle soup subdivided as far as the view needs
+	ImpostorMode  // a quad per sphere, ray cast in the fragment shader
+};
+SphereMode sphereMode = IndexedMode;
+GLuint impostorQuad; // corners of the impostor quad, drawn as a triangle strip
+bool benchmarkImpostors = false; // set with -impostorbench
+
+MeshArena meshArena; // CPU memory of the meshes that are regenerated as a whole
+GLuint adaptiveBuffer;
+GLsizei adaptiveCount;		 // vertices of the adaptive sphere
+GLfloat AdaptiveTolerance = 0.5; // screen-space error in pixels, set with -tolerance or the [/] keys
+
+// indexed spheres of MeshCacheMinLevel and finer are cached on disk, so startup maps the file instead of subdividing
+bool useMeshCache = true;			  // turned off with -nocache
+bool useShaderCache = true;			  // linked program binaries, turned off with -nocache or -noshadercache
+const char *MeshCacheDir = ".";	  // of the mesh and program files, set with -cache
+const int MeshCacheMinLevel = 7;	  // coarser levels subdivide faster than they load
+bool benchmarkLayouts = false;		  // set with -layoutbench
+bool formatReport = false;			  // print the vertex format report and quit, set with -formatreport
+int meshCacheMissing = -1;			  // level whose cache file is written once it has been uploaded
+
+// instanced spheres: with -instances N the selected sphere is drawn N times in one call, each instance placed,
+// sized and colored by its record in the instance buffer
+std::vector<SphereInstance> instances;
+size_t NumInstances = 0;								 // set with -instances
+const vec3 InstanceLow(-1.9, -1.9, 0.1), InstanceHigh(1.9, 1.9, 1.9); // the box they fill, inside the view volume
+GLfloat InstanceSpread = 1; // widens the box sideways by this factor, past the view, set with -spread
+GLfloat instanceRadius;									 // of the largest instance
+GLuint instanceBuffer;
+GLuint iOffsetScale = 2, iColor = 3; // instance attribute locations, bound before linking
+GLuint vBakedDiffuse = 4, vBakedRest = 5; // baked lighting attribute locations, bound before linking
+bool showFps = false;		 // redraw continuously and print the frame rate, set with -fps
+// with -cull only the instances in the view volume are drawn: their bounding spheres are culled whenever the
+// view changes, and the survivors copied to the instance buffer
+bool instanceCulling = false;
+SphereBounds instanceBounds;
+std::vector<GLuint> visibleInstances;
+std::vector<SphereInstance> drawnInstances; // instance buffer contents
+mat4 culledView;							// projection * model view of the last culling
+bool occlusionCulling = false;				// also drop the instances hidden behind nearer ones, set with -occlusion
+OcclusionBuffer occlusionBuffer;
+
+// every state change goes through the state cache, which drops the redundant ones, and every draw through the
+// render queue, which sorts them by program, mesh, material and depth; with -separate the instances are drawn
+// with one call each instead of one instanced call, to show the sorting at work
+GLStateCache glState;
+LightingUniforms lighting; // light and material values, uploaded once a frame when they changed
+RenderQueue renderQueue;
+bool separateDraws = false;
+
+// with -pointlights N the spheres are also lit by N point lights with a falloff radius, binned into screen tiles
+// whenever the view changes, so that each fragment loops only over the lights that reach its tile
+std::vector<PointLight> pointLights;
+size_t NumPointLights = 0; // set with -pointlights
+const vec3 PointLightLow(-1.9, -1.9, -1.9), PointLightHigh(1.9, 1.9, 1.9); // the box they fill
+const GLfloat PointLightRadiusLow = 0.2, PointLightRadiusHigh = 0.5;
+LightGrid lightGrid;
+mat4 binnedView, binnedProjection; // of the last binning
+int binnedWidth = 0, binnedHeight = 0;
+bool benchmarkTiled = false; // set with -tiledbench
+
+// with -baked (or the b key) the sphere is lit per vertex by a transform feedback pass whenever the lights, the
+// material, the variant or the sphere buffers change, and drawn with those colors in between
+bool bakedLighting = false;
+LightBaker lightBaker;
+GLint Baking; // uniform location
+
+std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now(); // program start
+
+// milliseconds since start
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// allocate the bound buffer and map it for writing; NULL if the driver cannot map it
+void *mapNewBuffer(GLenum target, GLsizeiptr bytes)
+{
+	glBufferData(target, bytes, NULL, GL_STATIC_DRAW);
+	return glMapBufferRange(target, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+// the eye in object space: a direction toward the viewer for an orthographic view, which looks along one
+// direction, and the eye position for a perspective one
+vec4 objectEye()
+{
+	if (projection[3][3] == 1.0)
+		return vec4(normalize(vec3(eye.x - at.x, eye.y - at.y, eye.z - at.z)), 0.0);
+	return eye;
+}
+
+// subdivide the triangle soup at the current level straight into its buffer
+void buildSoup()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	soupCount = GLsizei(soupVertices(NumTimesToSubdivide));
+	GLsizeiptr pointBytes = soupCount * sizeof(vec4);
+	GLsizeiptr normalBytes = soupCount * sizeof(vec3);
+	glState.bindBuffer(GL_ARRAY_BUFFER, soupBuffer);
+
+	// the generator writes into the mapped buffer, positions first and normals after them
+	char *mapped = (char *)mapNewBuffer(GL_ARRAY_BUFFER, pointBytes + normalBytes);
+	if (mapped)
+	{
+		SoupSink out = {(vec4 *)mapped, (vec3 *)(mapped + pointBytes)};
+		tetrahedron(out, NumTimesToSubdivide, NumThreads);
+		if (!glUnmapBuffer(GL_ARRAY_BUFFER)) // the contents were lost, e.g. on a mode switch
+			mapped = NULL;
+	}
+	if (!mapped)
+	{
+		meshArena.reset(TriangleSoup::arenaBytes(soupCount));
+		TriangleSoup soup(&meshArena);
+		tetrahedron(soup, NumTimesToSubdivide, NumThreads);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, pointBytes, &soup.points[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, pointBytes, normalBytes, &soup.normals[0]);
+	}
+	soupLevel = NumTimesToSubdivide;
+	sphereUploads++;
+
+	printf("triangle soup level %d: %d vertices, %ld bytes, generated %s in %.1f ms on %d threads\n",
+		   soupLevel, soupCount, (long)(pointBytes + normalBytes), mapped ? "into the mapped buffer" : "and copied",
+		   elapsedMs(start), NumThreads);
+}
+
+// subdivide the sphere for the current view and upload it
+void buildAdaptive()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SphereView view;
+	view.mvp = projection * model_view;
+	view.width = GLfloat(windowWidth);
+	view.height = GLfloat(windowHeight);
+	view.tolerance = AdaptiveTolerance;
+	view.maxEdge = 64.0;
+	view.maxCount = MaxTimesToSubdivide;
+	view.eye = objectEye();
+
+	// the last adaptive sphere is the best guess for the size of this one
+	size_t expected = adaptiveCount + adaptiveCount / 4;
+	meshArena.reset(TriangleSoup::arenaBytes(expected));
+	TriangleSoup soup(&meshArena);
+	soup.points.reserve(expected);
+	soup.normals.reserve(expected);
+	adaptiveTetrahedron(soup, view);
+	double generated = elapsedMs(start);
+
+	GLsizeiptr pointBytes = soup.points.size() * sizeof(vec4);
+	GLsizeiptr normalBytes = soup.normals.size() * sizeof(vec3);
+	glState.bindBuffer(GL_ARRAY_BUFFER, adaptiveBuffer);
+	glBufferData(GL_ARRAY_BUFFER, pointBytes + normalBytes, NULL, GL_STATIC_DRAW);
+	if (!soup.points.empty())
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, pointBytes, &soup.points[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, pointBytes, normalBytes, &soup.normals[0]);
+	}
+	adaptiveCount = GLsizei(soup.vertexCount());
+	sphereUploads++;
+
+	printf("adaptive sphere at %.2f px: %d triangles in %.1f ms\n", AdaptiveTolerance, adaptiveCount / 3, generated);
+	meshArena.print("mesh");
+}
+
+// finest indexed level whose data can be read; the refiner only appends beyond it
+int readyLevel()
+{
+	return refiner.running() ? refiner.readyLevel() : sphere.finest();
+}
+
+GLsizeiptr lodElementBytes(int level)
+{
+	return sphere.lodIndexCount(level) * (sphere.indexType(level) == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+}
+
+// the index lists of levels 0..level back to back in the index type of the finest one, with the range of each
+// written to out, which holds lodElementBytes(level) bytes
+GLenum lodElements(int level, void *out, LodRange *ranges)
+{
+	size_t first[MaxTimesToSubdivide + 1];
+	GLenum type = sphere.indexType(level);
+	GLsizeiptr size = type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	if (type == GL_UNSIGNED_SHORT)
+		sphere.lodIndices(level, (GLushort *)out, first);
+	else
+		sphere.lodIndices(level, (GLuint *)out, first);
+	for (int k = 0; k <= level; k++)
+	{
+		ranges[k].offset = first[k] * size;
+		ranges[k].count = GLsizei(sphere.indices(k).size());
+	}
+	return type;
+}
+
+// gather the meshlets of levels 0..level into out, with the range of each level
+void collectMeshlets(int level, std::vector<Meshlet> &out, MeshletRange *ranges)
+{
+	out.clear();
+	for (int k = 0; k <= level; k++)
+	{
+		ranges[k].first = out.size();
+		ranges[k].count = sphere.meshlets(k).size();
+		out.insert(out.end(), sphere.meshlets(k).begin(), sphere.meshlets(k).end());
+	}
+}
+
+// layout of `count` vertices of the indexed sphere
+VertexLayout indexedLayout(size_t count)
+{
+	return vertexLayout(indexedFormat, indexedLayoutKind, count);
+}
+
+// the packed vertices of the indexed sphere at `level`, as pieces stored back to back; float vertices that are
+// not interleaved are the sphere's own arrays, other ones are packed into `packed`
+int indexedVertexData(int level, std::vector<char> &packed, const char *pieces[2], GLsizeiptr bytes[2])
+{
+	VertexLayout layout = indexedLayout(sphere.vertexCount(level));
+	if (layout.format == FloatVertices && layout.kind != InterleavedLayout)
+	{
+		pieces[0] = (const char *)&sphere.points[0], bytes[0] = layout.count * sizeof(vec4);
+		pieces[1] = (const char *)&sphere.normals[0], bytes[1] = layout.count * sizeof(vec3);
+		return 2;
+	}
+	packed.resize(layout.bytes());
+	packVertices(layout, &sphere.points[0], &sphere.normals[0], &packed[0], NumThreads);
+	pieces[0] = &packed[0], bytes[0] = packed.size();
+	return 1;
+}
+
+// call f(buffer, offset in that buffer, data, bytes) on the packed vertex data, given as pieces, at most `most`
+// bytes at a time and never across two buffers of the layout
+template <class F>
+void forVertexSlices(const VertexLayout &layout, const char *const *pieces, const GLsizeiptr *bytes, int count,
+					 GLsizeiptr most, F f)
+{
+	size_t at = 0; // offset of the piece in the packed data
+	for (int p = 0; p < count; at += bytes[p++])
+		for (size_t done = 0; done < size_t(bytes[p]);)
+		{
+			size_t offset = at + done;
+			int b = layout.buffers > 1 && offset >= layout.bufferOffset[1] ? 1 : 0;
+			size_t end = std::min(at + bytes[p], layout.bufferOffset[b] + layout.bufferBytes[b]);
+			size_t length = std::min(size_t(most), end - offset);
+			f(b, offset - layout.bufferOffset[b], pieces[p] + done, length);
+			done += length;
+		}
+}
+
+// upload the vertices and index lists of all levels up to `level` into the indexed sphere buffers at once
+void uploadIndexed(int level)
+{
+	// the vertices of all built levels share the vertex buffers
+	indexedVertices = GLsizei(sphere.vertexCount(level));
+	VertexLayout layout = indexedLayout(indexedVertices);
+	std::vector<char> packed;
+	const char *pieces[2];
+	GLsizeiptr bytes[2];
+	int count = indexedVertexData(level, packed, pieces, bytes);
+	for (int b = 0; b < layout.buffers; b++)
+	{
+		glState.bindBuffer(GL_ARRAY_BUFFER, indexedBuffers[b]);
+		glBufferData(GL_ARRAY_BUFFER, layout.bufferBytes[b], NULL, GL_STATIC_DRAW);
+	}
+	forVertexSlices(layout, pieces, bytes, count, layout.bytes(), [](int b, size_t offset, const char *data, size_t length)
+					{
+		glState.bindBuffer(GL_ARRAY_BUFFER, indexedBuffers[b]);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, length, data); });
+
+	// the index lists are written straight into the mapped element buffer
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexedElements);
+	void *mapped = mapNewBuffer(GL_ELEMENT_ARRAY_BUFFER, lodElementBytes(level));
+	if (mapped)
+	{
+		indexedType = lodElements(level, mapped, lodRanges);
+		mapped = glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) ? mapped : NULL;
+	}
+	if (!mapped)
+	{
+		std::vector<char> elements(lodElementBytes(level));
+		indexedType = lodElements(level, &elements[0], lodRanges);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, elements.size(), &elements[0]);
+	}
+	collectMeshlets(level, meshlets, meshletRanges);
+	uploadedLevel = level;
+	sphereUploads++;
+}
+
+// file and key of the cached indexed sphere at `level`
+void meshCacheFile(int level, char *path, size_t size, MeshCacheKey &key)
+{
+	snprintf(path, size, "%s/sphere_level%d.mesh", MeshCacheDir, level);
+	MeshCacheKey k = {SphereGeneratorVersion, level, uint32_t(indexedFormat) | uint32_t(indexedLayoutKind) << 8 | uint32_t(sphere.optimize) << 16 |
+										  uint32_t(sphere.clusters) << 17,
+					  sphereVertices(level) <= 65536 ? GLenum(GL_UNSIGNED_SHORT) : GLenum(GL_UNSIGNED_INT)};
+	key = k;
+}
+
+// map the cache file of the level and check that it fits the current vertex layout; needs no GL context
+bool openIndexedCache(int level, MeshCacheFile &file)
+{
+	char path[1024];
+	MeshCacheKey key;
+	meshCacheFile(level, path, sizeof(path), key);
+	if (!file.open(path, key) || int(file.header.rangeCount) != level + 1)
+		return false;
+	VertexLayout layout = indexedLayout(file.header.vertexCount);
+	size_t clusters = 0;
+	for (int k = 0; k <= level; k++)
+		clusters += file.header.rangeClusters[k];
+	if (layout.bytes() != file.header.vertexBytes || clusters * sizeof(Meshlet) != file.header.clusterBytes)
+	{
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+// upload the level from its cache file, opened with openIndexedCache
+void uploadIndexedCache(int level, const MeshCacheFile &file)
+{
+	VertexLayout layout = indexedLayout(file.header.vertexCount);
+	size_t clusters = 0;
+	for (int k = 0; k <= level; k++)
+		clusters += file.header.rangeClusters[k];
+
+	// the mapped blocks are already laid out as the buffers want them
+	for (int b = 0; b < layout.buffers; b++)
+	{
+		glState.bindBuffer(GL_ARRAY_BUFFER, indexedBuffers[b]);
+		glBufferData(GL_ARRAY_BUFFER, layout.bufferBytes[b], file.vertices() + layout.bufferOffset[b], GL_STATIC_DRAW);
+	}
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexedElements);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, file.header.elementBytes, file.elements(), GL_STATIC_DRAW);
+	indexedVertices = GLsizei(file.header.vertexCount);
+	indexedType = file.header.key.indexType;
+	meshlets.assign((const Meshlet *)file.clusters(), (const Meshlet *)file.clusters() + clusters);
+	for (int k = 0; k <= level; k++)
+	{
+		lodRanges[k].offset = GLintptr(file.header.rangeOffset[k]);
+		lodRanges[k].count = GLsizei(file.header.rangeIndices[k]);
+		meshletRanges[k].first = k ? meshletRanges[k - 1].first + meshletRanges[k - 1].count : 0;
+		meshletRanges[k].count = file.header.rangeClusters[k];
+	}
+	uploadedLevel = level;
+	sphereUploads++;
+	printf("indexed sphere level %d loaded from its cache file after %.1f ms\n", level, elapsedMs(startTime));
+}
+
+// write the indexed sphere at `level` to its cache file, from its vertex pieces, element block and meshlets
+void writeIndexedCache(int level, const char *const *vertices, const GLsizeiptr *vertexBytes, int pieces,
+					   const char *elements, const LodRange *ranges, const std::vector<Meshlet> &clusters,
+					   const MeshletRange *clusterRanges)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	char path[1024];
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	meshCacheFile(level, path, sizeof(path), header.key);
+	header.vertexCount = uint32_t(sphere.vertexCount(level));
+	header.elementBytes = lodElementBytes(level);
+	header.rangeCount = level + 1;
+	for (int k = 0; k <= level; k++)
+	{
+		header.rangeOffset[k] = ranges[k].offset;
+		header.rangeIndices[k] = ranges[k].count;
+		header.rangeClusters[k] = uint32_t(clusterRanges[k].count);
+	}
+	header.clusterBytes = clusters.size() * sizeof(Meshlet);
+	uint64_t bytes[2];
+	for (int i = 0; i < pieces; i++)
+		bytes[i] = vertexBytes[i];
+	if (writeMeshCache(path, header, vertices, bytes, pieces, elements,
+					   clusters.empty() ? NULL : (const char *)&clusters[0]))
+		printf("wrote %s in %.1f ms\n", path, elapsedMs(start));
+	else
+		printf("could not write mesh cache %s\n", path);
+}
+
+// radius in pixels of a sphere in object space under the current view
+GLfloat projectedRadius(const vec4 &center, GLfloat radius)
+{
+	vec4 c = model_view * center;
+	vec4 top = projection * (c + vec4(0.0, radius, 0.0, 0.0));
+	c = projection * c;
+	return fabs(top.y / top.w - c.y / c.w) * 0.5 * windowHeight;
+}
+
+// finest indexed level that may be drawn
+int drawableLevel()
+{
+	return std::min(NumTimesToSubdivide, uploadedLevel);
+}
+
+// bind the buffers of the selected sphere, regenerating the soup if the level changed, and point the vertex attributes into them
+void bindSphereBuffers()
+{
+	if (sphereMode == IndexedMode)
+	{
+		glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexedElements);
+		vertexAttribPointers(glState, indexedLayout(indexedVertices), vPosition, vNormal, indexedBuffers);
+		glState.uniform1i(OctahedralNormals, VertexFormatInfos[indexedFormat].octahedral);
+		return;
+	}
+	glState.uniform1i(OctahedralNormals, GL_FALSE);
+	if (sphereMode == ImpostorMode) // vPosition.xy is the corner; vNormal is not read
+	{
+		glState.bindBuffer(GL_ARRAY_BUFFER, impostorQuad);
+		glState.attribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, 0);
+		glState.attribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, sizeof(vec4), 0);
+	}
+	else if (sphereMode == AdaptiveMode)
+	{
+		glState.bindBuffer(GL_ARRAY_BUFFER, adaptiveBuffer);
+		glState.attribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, 0);
+		glState.attribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(adaptiveCount * sizeof(vec4)));
+	}
+	else
+	{
+		if (soupLevel != NumTimesToSubdivide)
+			buildSoup();
+		glState.bindBuffer(GL_ARRAY_BUFFER, soupBuffer);
+		glState.attribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, 0);
+		glState.attribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(soupCount * sizeof(vec4)));
+	}
+}
+
+// point the instance attributes into a buffer of SphereInstance records, advancing once per instance
+void instanceAttribPointers(GLuint buffer)
+{
+	glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+	glState.attribPointer(iOffsetScale, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance),
+						  (const GLvoid *)offsetof(SphereInstance, offsetScale));
+	glState.attribPointer(iColor, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance),
+						  (const GLvoid *)offsetof(SphereInstance, color));
+	glState.attribDivisor(iOffsetScale, 1);
+	glState.attribDivisor(iColor, 1);
+	glState.enableAttrib(iOffsetScale, true);
+	glState.enableAttrib(iColor, true);
+}
+
+// point the instance attributes into the instance buffer, advancing once per instance; without instances they
+// hold one unit sphere at the origin, and with -separate they are set before each draw
+void bindInstances()
+{
+	if (instances.empty() || separateDraws)
+	{
+		glState.enableAttrib(iOffsetScale, false);
+		glState.enableAttrib(iColor, false);
+		glState.attrib4f(iOffsetScale, vec4(0.0, 0.0, 0.0, 1.0));
+		glState.attrib4f(iColor, vec4(1.0, 1.0, 1.0, 1.0));
+		return;
+	}
+	instanceAttribPointers(instanceBuffer);
+}
+
+//----------------------------------------------------------------------------
+// Progressive refinement: a coarse sphere is drawn at once while the refiner
+// builds the finer levels. Each finished level is uploaded into fresh buffers
+// a slice per idle call, and only swapped in once complete, so no frame waits
+// on a large upload. What the upload copies first is copied by a stager
+// thread, so no frame waits on that either.
+
+const int FirstLevel = 2;						 // level shown while the finer ones are refined
+const GLsizeiptr UploadBytesPerFrame = 4 << 20; // upload budget of one idle call
+
+struct PendingUpload
+{
+	int level = -1; // -1 when nothing is uploading
+	GLuint buffers[2] = {0, 0}, elements = 0;
+	std::thread stager;					// copies the data and cuts it into slices
+	std::atomic<bool> sliced = {false}; // the slices can be uploaded
+	std::atomic<bool> done = {false};	// the stager is done, including the cache file
+	struct Slice
+	{
+		GLenum target;
+		GLuint buffer;
+		GLintptr offset;
+		const char *data;
+		GLsizeiptr bytes;
+	};
+	std::vector<Slice> slices; // what is left to upload, front first
+	size_t next = 0;
+	std::vector<char> staged; // index lists of every level while they upload
+	std::vector<char> packed; // packed vertices while they upload
+	const char *vertexPieces[2] = {NULL, NULL};
+	GLsizeiptr vertexBytes[2] = {0, 0};
+	int pieces = 0;
+	GLenum indexType = 0;
+	LodRange ranges[MaxTimesToSubdivide + 1] = {};
+	std::vector<Meshlet> meshlets; // of every level, gathered while they upload
+	MeshletRange meshletRanges[MaxTimesToSubdivide + 1] = {};
+
+	~PendingUpload()
+	{
+		if (stager.joinable())
+			stager.join();
+	}
+} pending;
+
+void startUpload(int level)
+{
+	GLsizeiptr elementBytes = lodElementBytes(level);
+	VertexLayout layout = indexedLayout(sphere.vertexCount(level));
+
+	pending.level = level;
+	pending.slices.clear();
+	pending.next = 0;
+	pending.sliced = false;
+	pending.done = false;
+	glGenBuffers(2, pending.buffers);
+	for (int b = 0; b < layout.buffers; b++)
+	{
+		glState.bindBuffer(GL_ARRAY_BUFFER, pending.buffers[b]);
+		glBufferData(GL_ARRAY_BUFFER, layout.bufferBytes[b], NULL, GL_STATIC_DRAW);
+	}
+	glGenBuffers(1, &pending.elements);
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, pending.elements);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, elementBytes, NULL, GL_STATIC_DRAW);
+
+	// the level is ready, so the stager may read it while the refiner builds finer ones
+	bool cache = level == meshCacheMissing;
+	pending.stager = std::thread([level, cache, elementBytes, layout]()
+								 {
+		// the indices are staged, not written into a mapped buffer, so that they can be uploaded a slice at a time
+		pending.staged.resize(elementBytes);
+		pending.indexType = lodElements(level, &pending.staged[0], pending.ranges);
+		const char *elementData = &pending.staged[0];
+		pending.pieces = indexedVertexData(level, pending.packed, pending.vertexPieces, pending.vertexBytes);
+		collectMeshlets(level, pending.meshlets, pending.meshletRanges);
+
+		forVertexSlices(layout, pending.vertexPieces, pending.vertexBytes, pending.pieces, UploadBytesPerFrame,
+						[](int b, size_t offset, const char *data, size_t length)
+						{
+			PendingUpload::Slice slice = {GL_ARRAY_BUFFER, pending.buffers[b], GLintptr(offset), data, GLsizeiptr(length)};
+			pending.slices.push_back(slice); });
+		for (GLsizeiptr done = 0; done < elementBytes; done += UploadBytesPerFrame)
+		{
+			PendingUpload::Slice slice = {GL_ELEMENT_ARRAY_BUFFER, pending.elements, done, elementData + done,
+										  std::min(UploadBytesPerFrame, elementBytes - done)};
+			pending.slices.push_back(slice);
+		}
+		pending.sliced = true;
+		if (cache) // the staged data is exactly what the file holds
+			writeIndexedCache(level, pending.vertexPieces, pending.vertexBytes, pending.pieces, elementData, pending.ranges,
+							  pending.meshlets, pending.meshletRanges);
+		pending.done = true; });
+}
+
+// upload the next slice, once the stager has cut them; once everything is there and the stager is done, swap the new buffers in
+void continueUpload()
+{
+	if (!pending.sliced)
+		return;
+	if (pending.next < pending.slices.size())
+	{
+		PendingUpload::Slice &slice = pending.slices[pending.next++];
+		glState.bindBuffer(slice.target, slice.buffer);
+		glBufferSubData(slice.target, slice.offset, slice.bytes, slice.data);
+	}
+	if (pending.next < pending.slices.size() || !pending.done)
+		return;
+	pending.stager.join();
+
+	glState.deleteBuffers(2, indexedBuffers);
+	glState.deleteBuffers(1, &indexedElements);
+	std::copy(pending.buffers, pending.buffers + 2, indexedBuffers);
+	indexedElements = pending.elements;
+	indexedVertices = GLsizei(sphere.vertexCount(pending.level));
+	indexedType = pending.indexType;
+	std::copy(pending.ranges, pending.ranges + pending.level + 1, lodRanges);
+	meshlets.swap(pending.meshlets);
+	std::copy(pending.meshletRanges, pending.meshletRanges + pending.level + 1, meshletRanges);
+	uploadedLevel = pending.level;
+	if (pending.level == meshCacheMissing)
+		meshCacheMissing = -1;
+	pending.staged = std::vector<char>();
+	pending.packed = std::vector<char>();
+	pending.meshlets = std::vector<Meshlet>();
+	printf("indexed sphere level %d ready after %.1f ms: %d vertices, %d triangles\n", pending.level,
+		   elapsedMs(startTime), indexedVertices, (int)sphere.indices(pending.level).size() / 3);
+	if (sphere.cacheAfter(pending.level).acmr > 0)
+		printf("  vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", sphere.cacheBefore(pending.level).acmr,
+			   sphere.cacheAfter(pending.level).acmr, sphere.cacheBefore(pending.level).atvr,
+			   sphere.cacheAfter(pending.level).atvr);
+	pending.level = -1;
+
+	if (sphereMode == IndexedMode)
+	{
+		bindSphereBuffers();
+		glutPostRedisplay();
+	}
+}
+
+// follow the refiner: upload the finest ready level, and restart it if a finer level was asked for meanwhile
+void idle()
+{
+	int ready = readyLevel();
+	if (pending.level >= 0)
+		continueUpload();
+	else if (std::min(NumTimesToSubdivide, ready) > uploadedLevel)
+		startUpload(std::min(NumTimesToSubdivide, ready));
+	else if (!refiner.running() && NumTimesToSubdivide > std::max(ready, uploadedLevel))
+		refiner.start(sphere, NumTimesToSubdivide, NumThreads);
+	else if (!refiner.running() && !showFps)
+		glutIdleFunc(NULL); // nothing left to do until the level changes
+	if (showFps)
+		glutPostRedisplay(); // keep drawing to measure the frame rate
+}
+
+// bring the indexed sphere to NumTimesToSubdivide: built levels are shown at once, finer ones are refined in the background
+void updateIndexed()
+{
+	// levels up to uploadedLevel are drawn at once
+	if (NumTimesToSubdivide > uploadedLevel)
+	{
+		// meanwhile the finest uploaded level is drawn; the refiner is not restarted under a running upload,
+		// whose source pointers a new reservation could move
+		if (!refiner.running() && pending.level < 0 && NumTimesToSubdivide > sphere.finest())
+			refiner.start(sphere, NumTimesToSubdivide, NumThreads);
+		glutIdleFunc(idle);
+	}
+}
+
+// whether the variant can draw with baked lighting: impostors and tiled lights are lit per fragment only, and
+// point lights light each instance differently. NumInstances is set before the instance stage starts, so this
+// can be asked while the stage still fills `instances`
+bool bakeable(const ShaderVariant &v)
+{
+	return !v.impostor && !v.tiled && (v.directional || NumInstances == 0);
+}
+
+// the variant the sphere is drawn with, for the lighting choices of v: impostors have shaders of their own, and
+// baked lighting replaces the tiled lights where it can be used
+ShaderVariant drawnVariant(ShaderVariant v)
+{
+	v.impostor = sphereMode == ImpostorMode;
+	v.tiled = !pointLights.empty();
+	v.baked = false;
+	if (bakedLighting)
+	{
+		ShaderVariant baked = v;
+		baked.tiled = false;
+		baked.baked = true;
+		if (bakeable(baked))
+			v = baked;
+	}
+	return v;
+}
+
+// switch the sphere to NumTimesToSubdivide and the selected mode
+void updateSphere()
+{
+	if (sphereMode == IndexedMode)
+		updateIndexed();
+	else if (sphereMode == AdaptiveMode)
+		buildAdaptive();
+	ShaderVariant v = drawnVariant(shaderVariant);
+	if (variantKey(v) != variantKey(shaderVariant))
+		useVariant(v);
+	bindSphereBuffers();
+}
+
+// make a linked program the one of the variant, attaching its lighting block and looking up its uniforms; false
+// if it has no usable lighting block
+bool setVariantProgram(VariantProgram &p, GLuint linked)
+{
+	if (!lighting.attach(glState, linked))
+		return false;
+	p.program = linked;
+	p.modelView = glGetUniformLocation(linked, "ModelView");
+	p.projection = glGetUniformLocation(linked, "Projection");
+	p.octahedralNormals = glGetUniformLocation(linked, "OctahedralNormals");
+	p.tiledLights = glGetUniformLocation(linked, "TiledLights");
+	p.lightTiles = glGetUniformLocation(linked, "LightTiles");
+	p.lightEntries = glGetUniformLocation(linked, "LightEntries");
+	p.baking = glGetUniformLocation(linked, "Baking");
+	return true;
+}
+
+// compile the shader variant if this is its first use, and switch to it
+void useVariant(const ShaderVariant &v)
+{
+	VariantProgram &p = variantPrograms[variantKey(v)];
+	if (p.program == 0)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool cached;
+		if (!setVariantProgram(p, InitShader("vshader.glsl", "fshader.glsl", variantDefines(v).c_str(), &cached)))
+		{
+			std::cerr << "the shaders have no Lighting block laid out as LightingBlock" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		printf("shader variant %s %s in %.1f ms\n", variantName(v).c_str(), cached ? "loaded from its binary" : "compiled",
+			   elapsedMs(start));
+	}
+	shaderVariant = v;
+	program = p.program;
+	ModelView = p.modelView;
+	Projection = p.projection;
+	OctahedralNormals = p.octahedralNormals;
+	Baking = p.baking;
+	glState.useProgram(program);
+	glState.uniformMatrix4fv(Projection, projection); // the cache drops them if this program has them already
+	glState.uniformMatrix4fv(ModelView, model_view);
+	glState.uniform1i(OctahedralNormals, sphereMode == IndexedMode && VertexFormatInfos[indexedFormat].octahedral);
+	glState.uniform1i(p.tiledLights, TiledLightsFirstUnit);
+	glState.uniform1i(p.lightTiles, TiledLightsFirstUnit + 1);
+	glState.uniform1i(p.lightEntries, TiledLightsFirstUnit + 2);
+	glState.uniform1i(Baking, GL_FALSE);
+}
+
+//----------------------------------------------------------------------------
+// Shader hot reload: the shader files are watched, and when one is saved every
+// variant compiled so far is built again from the new sources. With parallel
+// shader compilation the driver builds them while frames are drawn, and each
+// is only checked once it is done; otherwise they are built in one go between
+// frames. A variant whose new program links is switched to it; one that fails
+// keeps its last good program, and the log is printed.
+
+const int ShaderWatchMs = 250; // how often the shader files are looked at
+ShaderWatcher shaderWatcher;
+
+struct ReloadingProgram
+{
+	int variant;
+	GLuint program; // building
+	std::string cachePath;
+	uint64_t cacheKey;
+};
+std::vector<ReloadingProgram> reloading;
+std::chrono::steady_clock::time_point reloadStart;
+
+// start building every compiled variant again from the shader files
+void startReload()
+{
+	std::string vs, fs;
+	if (!readWholeFile("vshader.glsl", vs) || !readWholeFile("fshader.glsl", fs))
+		return; // caught between writes; the next save brings it back
+	for (size_t i = 0; i < reloading.size(); i++) // the sources they were building are stale
+		glDeleteProgram(reloading[i].program);
+	reloading.clear();
+	reloadStart = std::chrono::steady_clock::now();
+	for (int k = 0; k < ShaderVariants; k++)
+	{
+		if (variantPrograms[k].program == 0)
+			continue;
+		std::string defines = variantDefines(variantOfKey(k));
+		ReloadingProgram r = {k, 0, "", 0};
+		bool cached = programCachePath(vs, fs, defines.c_str(), r.cachePath, r.cacheKey);
+		r.program = buildProgram(vs, fs, defines.c_str(), cached);
+		reloading.push_back(r);
+	}
+	printf("shaders changed, rebuilding %d variants%s\n", (int)reloading.size(),
+		   parallelShaderCompile ? " in the background" : "");
+}
+
+// switch the variants whose programs are built and linked to them
+void finishReload()
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < reloading.size(); i++)
+	{
+		ReloadingProgram &r = reloading[i];
+		if (!programBuilt(r.program))
+		{
+			reloading[kept++] = r;
+			continue;
+		}
+		VariantProgram &p = variantPrograms[r.variant];
+		GLuint last = p.program;
+		std::string log;
+		std::string name = variantName(variantOfKey(r.variant));
+		if (programLinked(r.program, log) && setVariantProgram(p, r.program))
+		{
+			if (!r.cachePath.empty())
+				saveProgramBinary(r.program, r.cachePath.c_str(), r.cacheKey);
+			glState.deleteProgram(last);
+			if (r.variant == variantKey(shaderVariant))
+			{
+				useVariant(shaderVariant);
+				glutPostRedisplay();
+			}
+			printf("shader variant %s reloaded after %.1f ms\n", name.c_str(), elapsedMs(reloadStart));
+		}
+		else
+		{
+			printf("shader variant %s failed to build, keeping the last good program:\n%s\n", name.c_str(),
+				   log.empty() ? "the shaders have no Lighting block laid out as LightingBlock" : log.c_str());
+			glDeleteProgram(r.program);
+		}
+	}
+	reloading.resize(kept);
+}
+
+// look for saved shader files, and finish the programs being rebuilt
+void watchShaders(int)
+{
+	if (shaderWatcher.changed())
+		startReload();
+	if (!reloading.empty())
+		finishReload();
+	glutTimerFunc(ShaderWatchMs, watchShaders, 0);
+}
+
+// the light positions in the lighting block: the first light where the keys put it, and each further one a
+// quarter turn further around the z axis
+void setLights()
+{
+	vec4 position = light_position;
+	for (int i = 0; i < MaxLights; i++)
+	{
+		lighting.setLightPosition(i, position);
+		position = vec4(-position.y, position.x, position.z, position.w);
+	}
+}
+
+//----------------------------------------------------------------------------
+// Startup runs as a small dependency graph, timed from the start of main:
+//
+//   mesh (load or subdivide) ---------------------------> mesh upload ------.
+//   instances (scatter, sort, bound) ---------------------------> upload ---+--> first frame
+//   context --> shader sources and compile -------------------------------'
+//
+// The mesh and instance stages need no GL context and run on threads of their
+// own from before glutInit; the refiner starts on the finer levels as soon as
+// the first level is built. Each stage logs when it is done.
+
+StartupTask meshStage, instanceStage;
+MeshCacheFile startupCache; // cache file of the starting level, if there is a good one
+bool startupCached = false;
+
+void logStartup(const char *stage)
+{
+	printf("startup: %-28s %8.1f ms\n", stage, elapsedMs(startTime));
+}
+
+// start the stages that need no GL context
+void startStartup()
+{
+	meshStage.start([]()
+					{
+		// the indexed sphere is loaded from its cache file, or starts coarse and is refined in the background,
+		// writing the cache file once it is done
+		bool cached = useMeshCache && NumTimesToSubdivide >= MeshCacheMinLevel;
+		if (cached && openIndexedCache(NumTimesToSubdivide, startupCache))
+		{
+			startupCached = true;
+			logStartup("mesh cache file mapped");
+			return;
+		}
+		if (cached)
+			meshCacheMissing = NumTimesToSubdivide;
+		sphere.subdivide(std::min(NumTimesToSubdivide, FirstLevel), NumThreads);
+		if (NumTimesToSubdivide > sphere.finest()) // reserves every level, so the first one stays where it is
+			refiner.start(sphere, NumTimesToSubdivide, NumThreads);
+		logStartup("first level subdivided"); });
+
+	if (NumInstances > 0)
+		instanceStage.start([]()
+							{
+			vec3 spread(InstanceSpread, InstanceSpread, 1.0);
+			instances = scatterSpheres(NumInstances, InstanceLow * spread, InstanceHigh * spread);
+			if (instanceCulling) // neighbours in the list share the bounding boxes of the coarse culling level
+			{
+				sortSpatially(instances);
+				setSphereBounds(instanceBounds, &instances[0], instances.size());
+				visibleInstances.resize(instanceBounds.padded());
+			}
+			drawnInstances = instances;
+			instanceRadius = 0;
+			for (size_t i = 0; i < instances.size(); i++)
+				instanceRadius = std::max(instanceRadius, instances[i].offsetScale.w);
+			logStartup("instances scattered"); });
+	if (NumPointLights > 0)
+		pointLights = scatterLights(NumPointLights, PointLightLow, PointLightHigh, PointLightRadiusLow,
+									PointLightRadiusHigh);
+}
+
+void init()
+{
+	logStartup("context created");
+	glGenBuffers(1, &soupBuffer);
+	glGenBuffers(2, indexedBuffers);
+	glGenBuffers(1, &adaptiveBuffer);
+	glGenBuffers(1, &indexedElements);
+	glGenBuffers(1, &instanceBuffer);
+	const vec4 corners[4] = {vec4(-1.0, -1.0, 0.0, 1.0), vec4(1.0, -1.0, 0.0, 1.0), vec4(-1.0, 1.0, 0.0, 1.0),
+							 vec4(1.0, 1.0, 0.0, 1.0)};
+	glGenBuffers(1, &impostorQuad);
+	glState.bindBuffer(GL_ARRAY_BUFFER, impostorQuad);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+	// Load shaders and use the resulting shader program, and rebuild them whenever their files are saved; this
+	// overlaps the mesh and instance stages
+	parallelShaderCompile = GLEW_KHR_parallel_shader_compile;
+	if (parallelShaderCompile)
+		glMaxShaderCompilerThreadsKHR(0xffffffff); // as many as the driver likes
+	useVariant(shaderVariant);
+	std::vector<std::string> shaderFiles;
+	shaderFiles.push_back("vshader.glsl");
+	shaderFiles.push_back("fshader.glsl");
+	if (shaderWatcher.watch(shaderFiles))
+		glutTimerFunc(ShaderWatchMs, watchShaders, 0);
+	logStartup("shaders built");
+
+	// upload the sphere once its stage is done
+	meshStage.wait();
+	if (startupCached)
+	{
+		uploadIndexedCache(NumTimesToSubdivide, startupCache);
+		startupCache.close();
+	}
+	else
+		uploadIndexed(std::min(NumTimesToSubdivide, FirstLevel));
+	logStartup("mesh uploaded");
+
+	// set up vertex arrays
+	glState.enableAttrib(vPosition, true);
+	glState.enableAttrib(vNormal, true);
+	updateSphere();
+
+	// upload the instances, if any
+	instanceStage.wait();
+	if (NumInstances > 0)
+	{
+		glState.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(SphereInstance), &instances[0],
+					 instanceCulling ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+		printf("%d instances of radius up to %.3f\n", (int)instances.size(), instanceRadius);
+		logStartup("instances uploaded");
+	}
+	bindInstances();
+
+	// the tiled light textures stay bound to their units; they are filled by the first binning
+	lightGrid.create();
+	lightGrid.bind();
+	lightBaker.create();
+
+	vec4 ambient_product = light_ambient * material_ambient;
+	vec4 diffuse_product = light_diffuse * material_diffuse;
+	vec4 specular_product = light_specular * material_specular;
+
+	// Set up the lighting block, uploaded with the first frame
+	lighting.setProducts(ambient_product, diffuse_product, specular_product);
+	light_position.w = isdirectional ? 0.0 : 1.0;
+	setLights();
+	lighting.setShininess(material_shininess);
+
+	glEnable(GL_DEPTH_TEST);
+	glClearColor(1.0, 1.0, 1.0, 1.0); /* white background */
+}
+
+//----------------------------------------------------------------------------
+
+// drop the meshlets of the level that lie outside the view or face away from the eye, and draw the others
+// with one call, joining neighbouring ranges
+void drawVisibleMeshlets(int level)
+{
+	vec4 planes[6];
+	frustumPlanes(projection * model_view, planes);
+	vec4 viewer = objectEye();
+	GLintptr indexSize = indexedType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+	drawCounts.clear();
+	drawOffsets.clear();
+	const MeshletRange &range = meshletRanges[level];
+	size_t drawn = 0, triangles = 0, culled = 0;
+	GLuint end = GLuint(-1); // triangle after the last range
+	for (size_t i = range.first; i < range.first + range.count; i++)
+	{
+		const Meshlet &m = meshlets[i];
+		if (meshletBackFacing(m, viewer) || meshletOutside(m, planes))
+		{
+			culled += m.count;
+			continue;
+		}
+		if (m.first == end)
+			drawCounts.back() += 3 * m.count;
+		else
+		{
+			drawCounts.push_back(3 * m.count);
+			drawOffsets.push_back((const GLvoid *)(lodRanges[level].offset + 3 * m.first * indexSize));
+		}
+		end = m.first + m.count;
+		drawn++;
+		triangles += m.count;
+	}
+	if (!drawCounts.empty())
+		glMultiDrawElements(GL_TRIANGLES, &drawCounts[0], indexedType, &drawOffsets[0], GLsizei(drawCounts.size()));
+
+	static size_t lastDrawn = size_t(-1);
+	if (drawn != lastDrawn) // the view changed
+		printf("meshlets: %d of %d drawn in %d ranges, %.1f%% of the triangles culled\n", (int)drawn,
+			   (int)range.count, (int)drawCounts.size(), 100.0 * culled / (culled + triangles));
+	lastDrawn = drawn;
+}
+
+// refill the instance buffer with the instances in view, if the view changed since the last time
+void cullInstances()
+{
+	mat4 view = projection * model_view;
+	if (memcmp(&view, &culledView, sizeof(view)) == 0)
+		return;
+	culledView = view;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	vec4 planes[6];
+	frustumPlanes(view, planes);
+	size_t n = cullSpheres(instanceBounds, planes, &visibleInstances[0]), inView = n;
+	if (occlusionCulling)
+		n = cullOccluded(occlusionBuffer, view, &instances[0], &visibleInstances[0], n, NumThreads);
+	double ms = elapsedMs(start);
+	drawnInstances.resize(n);
+	for (size_t i = 0; i < n; i++)
+		drawnInstances[i] = instances[visibleInstances[i]];
+	glState.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, n * sizeof(SphereInstance), n ? &drawnInstances[0] : NULL, GL_STREAM_DRAW);
+	printf("culling: %d of %d instances in view", (int)inView, (int)instances.size());
+	if (occlusionCulling)
+		printf(", %d of them hidden (%.1f%%)", (int)(inView - n), inView ? 100.0 * (inView - n) / inView : 0.0);
+	printf(", culled in %.3f ms\n", ms);
+}
+
+// vertices in the buffers of the drawn sphere
+GLsizei sphereVertices()
+{
+	return sphereMode == IndexedMode ? indexedVertices : sphereMode == AdaptiveMode ? adaptiveCount : soupCount;
+}
+
+// light the vertices of the drawn sphere into the baked lighting buffer, if the lights, the material, the program
+// or the sphere buffers changed since the last bake, and point the baked attributes at it; returns how long the
+// bake took in ms, or -1 if the last one still holds
+double bakeLighting()
+{
+	BakeKey key = {variantKey(shaderVariant), program, int(sphereMode), sphereVertices(), sphereUploads,
+				   lighting.revision()};
+	double ms = -1;
+	if (!lightBaker.current(key))
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		lightBaker.bindAttribs(glState, vBakedDiffuse, vBakedRest, false);
+		glState.useProgram(program);
+		glState.uniform1i(Baking, GL_TRUE);
+		lightBaker.bake(glState, key);
+		glState.uniform1i(Baking, GL_FALSE);
+		glFinish();
+		ms = elapsedMs(start);
+	}
+	lightBaker.bindAttribs(glState, vBakedDiffuse, vBakedRest, true);
+	return ms;
+}
+
+// bin the point lights into the screen tiles, if the view or the window changed since the last time
+void binLights()
+{
+	if (memcmp(&model_view, &binnedView, sizeof(mat4)) == 0 &&
+		memcmp(&projection, &binnedProjection, sizeof(mat4)) == 0 && windowWidth == binnedWidth && windowHeight == binnedHeight)
+		return;
+	binnedView = model_view;
+	binnedProjection = projection;
+	binnedWidth = windowWidth;
+	binnedHeight = windowHeight;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t entries = lightGrid.bin(pointLights, model_view, projection, windowWidth, windowHeight);
+	int tiles = lightGrid.tilesX * lightGrid.tilesY;
+	printf("tiled lights: %d lights in %d tiles, %.1f a tile on average, %d at most, binned in %.3f ms\n",
+		   (int)pointLights.size(), tiles, double(entries) / tiles, (int)lightGrid.maxPerTile, elapsedMs(start));
+}
+
+// print the frame rate once a second
+void countFrame(size_t triangles)
+{
+	static int frames = 0;
+	static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	frames++;
+	double ms = elapsedMs(start);
+	if (ms < 1000)
+		return;
+	printf("%.1f fps, %.2f ms per frame, %.1f M triangles per frame\n", frames * 1000.0 / ms, ms / frames,
+		   triangles / 1e6);
+	frames = 0;
+	start = std::chrono::steady_clock::now();
+}
+
+// draw the sphere picked for this frame: `copies` instances of it from the instance buffer with one call, or,
+// with no copies, the sphere alone, which the meshlets may cut down to what is in view
+void drawSphere(GLsizei copies)
+{
+	if (sphereMode == ImpostorMode)
+	{
+		if (copies > 0)
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, copies);
+		else
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // draw the quad of the sphere
+	}
+	else if (sphereMode == IndexedMode)
+	{
+		if (copies > 0)
+			glDrawElementsInstanced(GL_TRIANGLES, lodRanges[indexedLevel].count, indexedType,
+									(const GLvoid *)lodRanges[indexedLevel].offset, copies);
+		else if (meshletCulling && meshletRanges[indexedLevel].count > 0 && instances.empty())
+			drawVisibleMeshlets(indexedLevel); // the meshlet bounds are those of the unit sphere
+		else
+			glDrawElements(GL_TRIANGLES, lodRanges[indexedLevel].count, indexedType,
+						   (const GLvoid *)lodRanges[indexedLevel].offset); // draw the indexed sphere
+	}
+	else
+	{
+		GLsizei count = sphereMode == AdaptiveMode ? adaptiveCount : soupCount; // the adaptive sphere or the soup
+		if (copies > 0)
+			glDrawArraysInstanced(GL_TRIANGLES, 0, count, copies);
+		else
+			glDrawArrays(GL_TRIANGLES, 0, count); // draw the sphere
+	}
+}
+
+// time drawing the sphere of this frame in every shader variant, then go back to the current one
+void benchmarkShaderVariants(GLsizei copies)
+{
+	const int Draws = 20;
+	ShaderVariant current = shaderVariant;
+	lighting.flush(glState);
+	printf("%-36s %10s\n", "shader variant", "draw ms");
+	for (int k = 0; k < ShaderVariants; k++)
+	{
+		ShaderVariant v = variantOfKey(k);
+		if (v.impostor != current.impostor) // the other kind draws from other buffers
+			continue;
+		if (v.tiled && pointLights.empty()) // nothing to light with
+			continue;
+		if (v.baked && !bakeable(v))
+			continue;
+		useVariant(v);
+		if (v.baked) // the draws below only read what this wrote
+			bakeLighting();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		drawSphere(copies); // warm up
+		glFinish();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int d = 0; d < Draws; d++)
+			drawSphere(copies);
+		glFinish();
+		printf("%-36s %10.3f\n", variantName(v).c_str(), elapsedMs(start) / Draws);
+	}
+	useVariant(current);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// time drawing growing numbers of spheres, with one instanced draw, as meshes of the current level and as
+// impostors, then go back to the current mode
+void benchmarkImpostorSpheres()
+{
+	const int Draws = 10;
+	const size_t Counts[] = {1, 100, 1000, 10000, 100000};
+	SphereMode mode = sphereMode;
+	int level = indexedLevel;
+	indexedLevel = drawableLevel();
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	lighting.flush(glState);
+	printf("level %d meshes (%d triangles each) against impostors (2 triangles each), %d draws\n", indexedLevel,
+		   (int)(lodRanges[indexedLevel].count / 3), Draws);
+	printf("%10s %12s %12s\n", "spheres", "mesh ms", "impostor ms");
+	for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); c++)
+	{
+		std::vector<SphereInstance> spheres = scatterSpheres(Counts[c], InstanceLow, InstanceHigh);
+		glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, spheres.size() * sizeof(SphereInstance), &spheres[0], GL_STATIC_DRAW);
+		double ms[2];
+		for (int impostor = 0; impostor < 2; impostor++)
+		{
+			sphereMode = impostor ? ImpostorMode : IndexedMode;
+			useVariant(drawnVariant(shaderVariant));
+			bindSphereBuffers();
+			if (shaderVariant.baked)
+				bakeLighting();
+			instanceAttribPointers(buffer);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			drawSphere(GLsizei(Counts[c])); // warm up
+			glFinish();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int d = 0; d < Draws; d++)
+				drawSphere(GLsizei(Counts[c]));
+			glFinish();
+			ms[impostor] = elapsedMs(start) / Draws;
+		}
+		printf("%10d %12.3f %12.3f\n", (int)Counts[c], ms[0], ms[1]);
+	}
+	glState.deleteBuffers(1, &buffer);
+	sphereMode = mode;
+	indexedLevel = level;
+	useVariant(drawnVariant(shaderVariant));
+	bindSphereBuffers();
+	bindInstances();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// time drawing the sphere of this frame lit by growing numbers of tiled point lights, spread over the same box,
+// then go back to the current lights
+void benchmarkTiledLights(GLsizei copies)
+{
+	const int Draws = 20;
+	const size_t Counts[] = {0, 16, 64, 256, 1024, 4096};
+	std::vector<PointLight> current;
+	current.swap(pointLights);
+	ShaderVariant v = shaderVariant;
+	v.tiled = true;
+	v.baked = false;
+	useVariant(v);
+	lighting.flush(glState);
+	printf("%10s %14s %12s %12s %10s\n", "lights", "a tile (avg)", "most", "bin ms", "draw ms");
+	for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); c++)
+	{
+		pointLights =
+			scatterLights(Counts[c], PointLightLow, PointLightHigh, PointLightRadiusLow, PointLightRadiusHigh);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t entries = lightGrid.bin(pointLights, model_view, projection, windowWidth, windowHeight);
+		double binMs = elapsedMs(start);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		drawSphere(copies); // warm up
+		glFinish();
+		start = std::chrono::steady_clock::now();
+		for (int d = 0; d < Draws; d++)
+			drawSphere(copies);
+		glFinish();
+		int tiles = lightGrid.tilesX * lightGrid.tilesY;
+		printf("%10d %14.1f %12d %12.3f %10.3f\n", (int)Counts[c], double(entries) / tiles, (int)lightGrid.maxPerTile,
+			   binMs, elapsedMs(start) / Draws);
+	}
+	pointLights.swap(current);
+	binnedWidth = 0; // the grid holds the last count now
+	useVariant(drawnVariant(shaderVariant));
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// material part of a render key: the diffuse color to 5 bits a channel
+unsigned colorMaterial(const vec4 &color)
+{
+	unsigned key = 0;
+	for (int c = 0; c < 3; c++)
+		key = key << 5 | unsigned(std::min(std::max(color[c], 0.0f), 1.0f) * 31 + 0.5f);
+	return key;
+}
+
+void display(void)
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glState.resetCounters();
+
+	static bool firstFrame = true;
+	if (firstFrame)
+	{
+		logStartup("first frame");
+		firstFrame = false;
+	}
+
+	glState.uniformMatrix4fv(ModelView, model_view); // set up the model-view matrix
+	lighting.flush(glState); // upload the light and material values, if they changed
+
+	if (instanceCulling && !instances.empty())
+		cullInstances();
+	if (!pointLights.empty())
+		binLights();
+	if (shaderVariant.baked)
+	{
+		double ms = bakeLighting();
+		if (ms >= 0)
+			printf("baked lighting: %d vertices lit in %.3f ms\n", (int)sphereVertices(), ms);
+	}
+	else
+		lightBaker.bindAttribs(glState, vBakedDiffuse, vBakedRest, false);
+	bool instanced = !instances.empty();
+	GLsizei copies = GLsizei(drawnInstances.size());
+	size_t triangles;
+	if (sphereMode == IndexedMode)
+	{
+		// pick the level of this draw; the unit sphere sits at the origin, the instances are no larger than
+		// instanceRadius, and the projection is orthographic, so their position does not matter
+		if (autoLod)
+			indexedLevel = selectSphereLevel(projectedRadius(vec4(0.0, 0.0, 0.0, 1.0), instanced ? instanceRadius : 1.0),
+											 AdaptiveTolerance, indexedLevel, drawableLevel());
+		else
+			indexedLevel = drawableLevel();
+		triangles = lodRanges[indexedLevel].count / 3;
+	}
+	else if (sphereMode == ImpostorMode)
+		triangles = 2;
+	else
+		triangles = (sphereMode == AdaptiveMode ? adaptiveCount : soupCount) / 3;
+	if (benchmarkImpostors && (drawableLevel() == NumTimesToSubdivide || sphereMode != IndexedMode))
+	{
+		benchmarkImpostorSpheres();
+		benchmarkImpostors = false;
+	}
+	if (benchmarkShaders && (sphereMode != IndexedMode || indexedLevel == NumTimesToSubdivide))
+	{
+		benchmarkShaderVariants(instanced && !separateDraws ? copies : 0);
+		benchmarkShaders = false;
+	}
+	if (benchmarkTiled && (sphereMode != IndexedMode || indexedLevel == NumTimesToSubdivide))
+	{
+		benchmarkTiledLights(instanced && !separateDraws ? copies : 0);
+		benchmarkTiled = false;
+	}
+
+	// queue the draws: the whole batch of instances, or each instance on its own with -separate; there is one
+	// program, that of the current variant, and one set of sphere buffers, picked by the sphere mode and level
+	unsigned mesh = unsigned(sphereMode) << 5 | unsigned(sphereMode == IndexedMode ? indexedLevel : 0);
+	unsigned programIndex = variantKey(shaderVariant);
+	renderQueue.clear();
+	if (instanced && separateDraws)
+	{
+		mat4 mvp = projection * model_view;
+		for (size_t i = 0; i < drawnInstances.size(); i++)
+		{
+			const vec4 &center = drawnInstances[i].offsetScale;
+			vec4 clip = mvp * vec4(center.x, center.y, center.z, 1.0);
+			GLfloat depth = clip.z / clip.w * 0.5f + 0.5f;
+			renderQueue.push(renderKey(programIndex, mesh, colorMaterial(drawnInstances[i].color), depth), GLuint(i));
+		}
+	}
+	else
+		renderQueue.push(renderKey(programIndex, mesh, colorMaterial(material_diffuse), 0.5), 0);
+	renderQueue.sort();
+
+	for (size_t i = 0; i < renderQueue.items.size(); i++)
+	{
+		glState.useProgram(program);
+		if (instanced && separateDraws)
+		{
+			const SphereInstance &instance = drawnInstances[renderQueue.items[i].object];
+			glState.attrib4f(iOffsetScale, instance.offsetScale);
+			glState.attrib4f(iColor, instance.color);
+			drawSphere(0);
+		}
+		else
+			drawSphere(instanced ? copies : 0);
+	}
+	glutSwapBuffers(); // swap the buffers
+
+	static GLStateCache::Counters lastCounters = {size_t(-1), size_t(-1)};
+	if (glState.counters.issued != lastCounters.issued || glState.counters.skipped != lastCounters.skipped)
+		printf("gl state: %d calls issued, %d skipped, for %d draws\n", (int)glState.counters.issued,
+			   (int)glState.counters.skipped, (int)renderQueue.items.size());
+	lastCounters = glState.counters;
+	if (showFps)
+		countFrame(triangles * (instanced ? copies : 1));
+}
+
+//----------------------------------------------------------------------------
+
+// light color function
+void setLightColor(float r, float g, float b)
+{
+	light_diffuse = vec4(r, g, b, 1.0); // set up the diffuse light color and change the sphere color
+	lighting.setDiffuseProduct(light_diffuse * material_diffuse); // set up the diffuse product in the shader
+
+	glutPostRedisplay(); // redraw the sphere
+}
+
+//----------------------------------------------------------------------------
+// color menu function
+void colorMenu(int id)
+{
+	switch (id)
+	{
+	case 1:
+		setLightColor(1.0, 0.0, 0.0); // Red
+		break;
+	case 2:
+		setLightColor(0.0, 1.0, 0.0); // Green
+		break;
+	case 3:
+		setLightColor(0.0, 0.0, 1.0); // Blue
+		break;
+	case 4:
+		setLightColor(1.0, 1.0, 1.0); // White
+		break;
+	case 5:
+		setLightColor(1.0, 1.0, 0.0); // Yellow
+		break;
+	case 6:
+		setLightColor(1.0, 0.0, 1.0); // Magenta
+		break;
+	case 7:
+		setLightColor(0.0, 1.0, 1.0); // Cyan
+		break;
+	}
+}
+// create the menu
+void createMenu()
+{
+	glutCreateMenu(colorMenu);
+	glutAddMenuEntry("Red", 1);
+	glutAddMenuEntry("Green", 2);
+	glutAddMenuEntry("Blue", 3);
+	glutAddMenuEntry("White", 4);
+	glutAddMenuEntry("Yellow", 5);
+	glutAddMenuEntry("Magenta", 6);
+	glutAddMenuEntry("Cyan", 7);
+	glutAttachMenu(GLUT_RIGHT_BUTTON);
+}
+
+//----------------------------------------------------------------------------
+
+void keyboard(unsigned char key, int x, int y)
+{
+	switch (key)
+	{
+	case 033: // Escape Key
+	case 'r':
+		dx += 0.1; // move the light source in the x direction
+		break;
+	case 'l':
+		dx -= 0.1; // move the light source in the -x direction
+		break;
+	case 'u':
+		dy += 0.1; // move the light source in the y direction
+		break;
+	case 'd':
+		dy -= 0.1; // move the light source in the -y direction
+		break;
+	case 'q':
+	case 'Q':
+		exit(EXIT_SUCCESS);
+		break;
+	// toggle light type(directional or point), each with a shader variant of its own
+	case 't':
+		isdirectional = !isdirectional; // change the light type
+		shaderVariant.directional = isdirectional;
+		useVariant(drawnVariant(shaderVariant));
+		break;
+	// toggle the specular highlight
+	case 's':
+		shaderVariant.specular = !shaderVariant.specular;
+		useVariant(drawnVariant(shaderVariant));
+		break;
+	// step through 1 to MaxLights lights
+	case 'n':
+		shaderVariant.lights = shaderVariant.lights % MaxLights + 1;
+		useVariant(drawnVariant(shaderVariant));
+		break;
+	// toggle the baked per-vertex lighting
+	case 'b':
+		bakedLighting = !bakedLighting;
+		useVariant(drawnVariant(shaderVariant));
+		if (bakedLighting && !shaderVariant.baked)
+			printf("baked lighting: not with impostors, or point lights on instances; lighting per fragment\n");
+		break;
+	// toggle between the indexed mesh and the triangle soup
+	case 'i':
+		sphereMode = sphereMode == IndexedMode ? SoupMode : IndexedMode;
+		updateSphere();
+		break;
+	// toggle the ray-cast impostors
+	case 'p':
+		sphereMode = sphereMode == ImpostorMode ? IndexedMode : ImpostorMode;
+		updateSphere();
+		break;
+	// toggle the view-dependent adaptive subdivision and change its error threshold
+	case 'a':
+		sphereMode = sphereMode == AdaptiveMode ? IndexedMode : AdaptiveMode;
+		updateSphere();
+		break;
+	// toggle the level selection from the projected radius
+	case 'o':
+		autoLod = !autoLod;
+		break;
+	// toggle the meshlet culling
+	case 'm':
+		meshletCulling = !meshletCulling;
+		if (meshletCulling && meshlets.empty())
+			printf("no meshlets: start with -meshlets to build them\n");
+		break;
+	case '[':
+		AdaptiveTolerance *= 0.5;
+		updateSphere();
+		break;
+	case ']':
+		AdaptiveTolerance *= 2.0;
+		updateSphere();
+		break;
+	// change the subdivision level
+	case '+':
+	case '=':
+		if (NumTimesToSubdivide < MaxTimesToSubdivide)
+			NumTimesToSubdivide++;
+		updateSphere();
+		break;
+	case '-':
+		if (NumTimesToSubdivide > 0)
+			NumTimesToSubdivide--;
+		updateSphere();
+		break;
+	}
+	// set the light position and change the light type with the keyboard input
+	light_position = vec4(2.0 + dx, 2.0 + dy, 2.0, isdirectional ? 0.0 : 1.0);
+	setLights();
+	glutPostRedisplay();
+}
+
+//----------------------------------------------------------------------------
+// reshape function to set up the projection matrix and the viewport matrix when the window size is changed
+void reshape(int width, int height)
+{
+	glViewport(0, 0, width, height);
+
+	GLfloat left = -2.0, right = 2.0;
+	GLfloat top = 2.0, bottom = -2.0;
+	GLfloat zNear = -2.0, zFar = 2.0;
+	GLfloat aspect = GLfloat(width) / height; // set up the aspect ratio of the window size to keep the sphere in the correct shape
+
+	if (aspect > 1.0)
+	{
+		left *= aspect;
+		right *= aspect;
+	}
+	else
+	{
+		top /= aspect;
+		bottom /= aspect;
+	}
+	// set up the projection matrix and send it to the shader
+	projection = Ortho(left, right, bottom, top, zNear, zFar); // Orthographic projection
+	glState.uniformMatrix4fv(Projection, projection);		   // set up the projection matrix in the shader
+
+	// the adaptive sphere depends on the size of the sphere on screen
+	windowWidth = width;
+	windowHeight = height;
+	if (sphereMode == AdaptiveMode)
+		updateSphere();
+}
+
+//----------------------------------------------------------------------------
+
+// time packing, uploading and drawing the indexed sphere at the current level in every vertex format and layout
+void benchmarkVertexLayouts()
+{
+	const int Draws = 20;
+	refiner.finish(); // the refiner is working toward this level already
+	int level = NumTimesToSubdivide;
+	sphere.subdivide(level, NumThreads);
+	size_t count = sphere.vertexCount(level);
+
+	GLuint buffers[2], elements;
+	glGenBuffers(2, buffers);
+	glGenBuffers(1, &elements);
+	std::vector<char> indices(lodElementBytes(level));
+	LodRange ranges[MaxTimesToSubdivide + 1];
+	GLenum type = lodElements(level, &indices[0], ranges);
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, elements);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size(), &indices[0], GL_STATIC_DRAW);
+	glState.uniformMatrix4fv(ModelView, model_view);
+	reshape(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT)); // sets the projection, as it has not run yet
+
+	printf("level %d, %d vertices, %d draws per layout\n", level, (int)count, Draws);
+	printf("%-8s %-12s %8s %10s %10s %10s\n", "format", "layout", "MB", "pack ms", "upload ms", "draw ms");
+	for (int f = 0; f < VertexFormats; f++)
+		for (int k = 0; k < VertexLayouts; k++)
+		{
+			VertexLayout layout = vertexLayout(VertexFormat(f), VertexLayoutKind(k), count);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			std::vector<char> packed(layout.bytes());
+			packVertices(layout, &sphere.points[0], &sphere.normals[0], &packed[0], NumThreads);
+			double pack = elapsedMs(start);
+
+			glFinish();
+			start = std::chrono::steady_clock::now();
+			for (int b = 0; b < layout.buffers; b++)
+			{
+				glState.bindBuffer(GL_ARRAY_BUFFER, buffers[b]);
+				glBufferData(GL_ARRAY_BUFFER, layout.bufferBytes[b], &packed[layout.bufferOffset[b]], GL_STATIC_DRAW);
+			}
+			vertexAttribPointers(glState, layout, vPosition, vNormal, buffers);
+			glState.uniform1i(OctahedralNormals, VertexFormatInfos[f].octahedral);
+			glFinish();
+			double upload = elapsedMs(start);
+
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glDrawElements(GL_TRIANGLES, ranges[level].count, type, (const GLvoid *)ranges[level].offset); // warm up
+			glFinish();
+			start = std::chrono::steady_clock::now();
+			for (int d = 0; d < Draws; d++)
+				glDrawElements(GL_TRIANGLES, ranges[level].count, type, (const GLvoid *)ranges[level].offset);
+			glFinish();
+			double draw = elapsedMs(start) / Draws;
+
+			printf("%-8s %-12s %8.2f %10.2f %10.2f %10.3f\n", VertexFormatInfos[f].name, VertexLayoutNames[k],
+				   layout.bytes() / 1048576.0, pack, upload, draw);
+		}
+
+	glState.deleteBuffers(2, buffers);
+	glState.deleteBuffers(1, &elements);
+	bindSphereBuffers();
+}
+
+// memory and precision of the indexed sphere at the current level in every vertex format
+void printVertexFormatReport()
+{
+	sphere.subdivide(NumTimesToSubdivide, NumThreads);
+	size_t count = sphere.vertexCount(NumTimesToSubdivide);
+	printf("level %d, %d vertices\n", NumTimesToSubdivide, (int)count);
+	printf("%-8s %6s %10s %14s %14s\n", "format", "bytes", "MB", "max position", "max normal");
+	for (int f = 0; f < VertexFormats; f++)
+	{
+		VertexFormatError error = vertexFormatError(VertexFormat(f), &sphere.points[0], &sphere.normals[0], count);
+		printf("%-8s %6d %10.2f %14.3g %12.5f deg\n", VertexFormatInfos[f].name, (int)vertexBytes(VertexFormat(f), 1),
+			   vertexBytes(VertexFormat(f), count) / 1048576.0, error.position, error.angle);
+	}
+}
+
+int main(int argc, char **argv)
+{
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-soup") == 0) // start with the triangle soup instead of the indexed mesh
+			sphereMode = SoupMode;
+		else if (strcmp(argv[i], "-adaptive") == 0) // start with the adaptive sphere
+			sphereMode = AdaptiveMode;
+		else if (strcmp(argv[i], "-impostors") == 0) // start with the ray-cast impostors
+			sphereMode = ImpostorMode;
+		else if (strcmp(argv[i], "-impostorbench") == 0) // time meshes against impostors on the first full level frame
+			benchmarkImpostors = true;
+		else if (strcmp(argv[i], "-lod") == 0) // pick the level of the indexed sphere from its projected radius
+			autoLod = true;
+		else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc) // adaptive error threshold in pixels
+			AdaptiveTolerance = GLfloat(atof(argv[++i]));
+		else if (strcmp(argv[i], "-level") == 0 && i + 1 < argc) // subdivision level
+			NumTimesToSubdivide = std::max(0, std::min(MaxTimesToSubdivide, atoi(argv[++i])));
+		else if (strcmp(argv[i], "-format") == 0 && i + 1 < argc) // vertex format of the indexed sphere
+		{
+			i++;
+			for (int f = 0; f < VertexFormats; f++)
+				if (strcmp(argv[i], VertexFormatInfos[f].name) == 0)
+					indexedFormat = VertexFormat(f);
+		}
+		else if (strcmp(argv[i], "-layout") == 0 && i + 1 < argc) // vertex layout of the indexed sphere
+		{
+			i++;
+			for (int l = 0; l < VertexLayouts; l++)
+				if (strcmp(argv[i], VertexLayoutNames[l]) == 0)
+					indexedLayoutKind = VertexLayoutKind(l);
+		}
+		else if (strcmp(argv[i], "-point") == 0) // start with a point light
+			isdirectional = shaderVariant.directional = false;
+		else if (strcmp(argv[i], "-nospecular") == 0) // start without the specular highlight
+			shaderVariant.specular = false;
+		else if (strcmp(argv[i], "-lights") == 0 && i + 1 < argc) // number of lights
+			shaderVariant.lights = std::max(1, std::min(MaxLights, atoi(argv[++i])));
+		else if (strcmp(argv[i], "-pointlights") == 0 && i + 1 < argc) // add this many tiled point lights
+		{
+			NumPointLights = std::max(0, atoi(argv[++i]));
+			shaderVariant.tiled = NumPointLights > 0;
+		}
+		else if (strcmp(argv[i], "-tiledbench") == 0) // time more and more tiled point lights on the first full level frame
+			benchmarkTiled = true;
+		else if (strcmp(argv[i], "-baked") == 0) // light the vertices once, and again only when the lighting changes
+			bakedLighting = true;
+		else if (strcmp(argv[i], "-shaderbench") == 0) // time every shader variant on the first full level frame
+			benchmarkShaders = true;
+		else if (strcmp(argv[i], "-layoutbench") == 0) // time every vertex format and layout after startup
+			benchmarkLayouts = true;
+		else if (strcmp(argv[i], "-formatreport") == 0) // print the size and error of every vertex format, and quit
+			formatReport = true;
+		else if (strcmp(argv[i], "-instances") == 0 && i + 1 < argc) // draw this many spheres with one instanced draw
+			NumInstances = std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-cull") == 0) // draw only the instances in view
+			instanceCulling = true;
+		else if (strcmp(argv[i], "-occlusion") == 0) // draw only the instances in view that nothing nearer hides
+			instanceCulling = occlusionCulling = true;
+		else if (strcmp(argv[i], "-spread") == 0 && i + 1 < argc) // widen the box of the instances past the view
+			InstanceSpread = std::max(GLfloat(1), GLfloat(atof(argv[++i])));
+		else if (strcmp(argv[i], "-separate") == 0) // one draw call per instance, sorted through the render queue
+			separateDraws = true;
+		else if (strcmp(argv[i], "-fps") == 0) // redraw continuously and print the frame rate
+			showFps = true;
+		else if (strcmp(argv[i], "-meshlets") == 0) // group the indexed sphere into meshlets and cull them
+			sphere.clusters = meshletCulling = true;
+		else if (strcmp(argv[i], "-novcache") == 0) // keep the subdivision order of the triangles and vertices
+			sphere.optimize = false;
+		else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc) // directory of the mesh cache files
+			MeshCacheDir = argv[++i];
+		else if (strcmp(argv[i], "-nocache") == 0) // always subdivide and compile at startup
+			useMeshCache = useShaderCache = false;
+		else if (strcmp(argv[i], "-noshadercache") == 0) // always compile the shaders at startup
+			useShaderCache = false;
+		else if (strcmp(argv[i], "-hugepages") == 0) // back the mesh arena with transparent huge pages
+			meshArena.hugePages = true;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) // subdivision threads
+			NumThreads = std::max(1, atoi(argv[++i]));
+	}
+	if (formatReport) // after every flag, so that it reports the level they chose
+	{
+		printVertexFormatReport();
+		return 0;
+	}
+	startStartup();											   // start the stages that need no context
+	glutInit(&argc, argv);									   // initialize the glut
+	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH); // set up the display mode
+	glutInitWindowSize(512, 512);							   // set up the window size
+	glutInitWindowPosition(0, 0);							   // set up the window position
+	glutCreateWindow("Project_Erfan_GhaziAsgar");			   // create the window
+	glewInit();												   // initialize the glew
+	init();													   // initialize the program
+	if (showFps)
+		glutIdleFunc(idle); // keeps redrawing
+	if (benchmarkLayouts)
+		benchmarkVertexLayouts();
+	glutDisplayFunc(display);								   // set up the display function
+	glutReshapeFunc(reshape);								   // set up the reshape function
+	glutKeyboardFunc(keyboard);								   // set up the keyboard function
+	createMenu();											   // create the menu
+	glutMainLoop();											   // run the main loop
+}
+
+//----------------------------------------------------------------------------
+// Shader
+
+// hand the source to the shader with the defines inserted after its first line, the #version line
+static void shaderSource(GLuint shader, const char *source, const char *defines)
+{
+	const char *body = strchr(source, '\n');
+	body = body ? body + 1 : source + strlen(source);
+	const GLchar *pieces[3] = {source, defines, body};
+	GLint lengths[3] = {GLint(body - source), -1, -1};
+	glShaderSource(shader, 3, pieces, lengths);
+}
+
+// create the program and start compiling and linking it; with parallel shader compilation this returns before
+// the driver is done, which programBuilt() tells
+static GLuint buildProgram(const std::string &vs, const std::string &fs, const char *defines, bool retrievable)
+{
+	GLuint program = glCreateProgram();
+	if (retrievable)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	GLuint VertexShader = glCreateShader(GL_VERTEX_SHADER);
+	shaderSource(VertexShader, vs.c_str(), defines);
+	glCompileShader(VertexShader);
+	glAttachShader(program, VertexShader);
+
+	GLuint FragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	shaderSource(FragmentShader, fs.c_str(), defines);
+	glCompileShader(FragmentShader);
+	glAttachShader(program, FragmentShader);
+
+	// the same attribute locations in every program, so that the vertex arrays serve them all
+	glBindAttribLocation(program, vPosition, "vPosition");
+	glBindAttribLocation(program, vNormal, "vNormal");
+	glBindAttribLocation(program, iOffsetScale, "iOffsetScale");
+	glBindAttribLocation(program, iColor, "iColor");
+	glBindAttribLocation(program, vBakedDiffuse, "vBakedDiffuse");
+	glBindAttribLocation(program, vBakedRest, "vBakedRest");
+	if (strstr(defines, "#define BAKED\n")) // the outputs of the bake, captured by transform feedback
+		glTransformFeedbackVaryings(program, BakedVaryings, BakedVaryingNames, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(program);
+	return program;
+}
+
+// whether the driver is done building the program, without waiting for it
+static bool programBuilt(GLuint program)
+{
+	GLint done = GL_TRUE;
+	if (parallelShaderCompile)
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+// wait for the program to be built and tell whether it linked; if not, the logs of the shaders that failed to
+// compile and of the link are appended to `log`. Its shaders are deleted either way
+static bool programLinked(GLuint program, std::string &log)
+{
+	GLint linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	GLuint shaders[2];
+	GLsizei count = 0;
+	glGetAttachedShaders(program, 2, &count, shaders);
+	for (GLsizei i = 0; i < count; i++)
+	{
+		GLint compiled, logSize;
+		glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+		glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &logSize);
+		if (!compiled && logSize > 1)
+		{
+			std::vector<char> logMsg(logSize);
+			glGetShaderInfoLog(shaders[i], logSize, NULL, &logMsg[0]);
+			log += &logMsg[0];
+		}
+		glDetachShader(program, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+	if (!linked)
+	{
+		GLint logSize;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logSize);
+		if (logSize > 1)
+		{
+			std::vector<char> logMsg(logSize);
+			glGetProgramInfoLog(program, logSize, NULL, &logMsg[0]);
+			log += &logMsg[0];
+		}
+	}
+	return linked == GL_TRUE;
+}
+
+// the program cache file and key of the sources; false if programs are not cached
+static bool programCachePath(const std::string &vs, const std::string &fs, const char *defines, std::string &path,
+							 uint64_t &key)
+{
+	if (!useShaderCache || !programBinariesSupported())
+		return false;
+	std::vector<std::string> texts;
+	texts.push_back(vs);
+	texts.push_back(fs);
+	texts.push_back(defines);
+	char attribs[64];
+	snprintf(attribs, sizeof(attribs), "%u %u %u %u %u %u", vPosition, vNormal, iOffsetScale, iColor, vBakedDiffuse,
+			 vBakedRest);
+	texts.push_back(attribs);
+	key = programCacheKey(texts);
+	char name[64];
+	snprintf(name, sizeof(name), "/shader_%016llx.bin", (unsigned long long)key);
+	path = std::string(MeshCacheDir) + name;
+	return true;
+}
+
+GLuint InitShader(const char *vShaderFile, const char *fShaderFile, const char *defines, bool *fromCache)
+{
+	std::string svs, sfs;
+	if (!readWholeFile(vShaderFile, svs) || !readWholeFile(fShaderFile, sfs))
+	{
+		printf("\n failed to read %s or %s\n", vShaderFile, fShaderFile);
+		exit(EXIT_FAILURE);
+	}
+
+	// a program linked before from the same sources, on the same driver, is loaded from its binary
+	std::string path;
+	uint64_t key = 0;
+	bool cached = programCachePath(svs, sfs, defines, path, key);
+	if (fromCache)
+		*fromCache = false;
+	if (cached)
+	{
+		GLuint program = glCreateProgram();
+		if (loadProgramBinary(program, path.c_str(), key))
+		{
+			if (fromCache)
+				*fromCache = true;
+			return program;
+		}
+		glDeleteProgram(program);
+	}
+
+	GLuint program = buildProgram(svs, sfs, defines, cached);
+	std::string log;
+	if (!programLinked(program, log))
+	{
+		printf("\n failed to compile or link %s and %s\n  %s", vShaderFile, fShaderFile, log.c_str());
+		exit(EXIT_FAILURE);
+	}
+	if (cached && !saveProgramBinary(program, path.c_str(), key))
+		printf("could not write the program cache file %s\n", path.c_str());
+
+	return program; // made current through glState
+}
@@ -0,0 +1,184 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- arena.h ---
+//
+//  Bump allocator for mesh data that is rebuilt as a whole
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__unix__)
+#include <sys/mman.h>
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  MeshArena - memory for one generation of a mesh
+//
+//  Allocations are carved out of large blocks and never freed one by one;
+//  reset() drops everything at once before the next regeneration, which
+//  passes the size it expects to need. When a generation needed more than
+//  one block, reset() replaces them with a single block of the combined
+//  size, so after the first regeneration at a level, regenerating again
+//  asks the system for no memory at all.
+//
+//  Blocks are mapped directly from the system and, when hugePages is set,
+//  advised to use transparent huge pages, which cuts TLB misses on meshes of
+//  hundreds of megabytes.
+//
+
+class MeshArena
+{
+	struct Block
+	{
+		char *base;
+		size_t size;
+	};
+	std::vector<Block> blocks; // the last one is being allocated from
+	size_t used;			   // bytes used in the last block
+
+	static const size_t MinBlock = 1 << 20;
+	static const size_t HugePage = 2 << 20;
+
+	Block map(size_t size)
+	{
+		Block b;
+		b.size = (size + 4095) & ~size_t(4095);
+#if defined(__unix__)
+		void *p = mmap(NULL, b.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			p = NULL;
+#ifdef MADV_HUGEPAGE
+		if (p && hugePages && b.size >= HugePage)
+			madvise(p, b.size, MADV_HUGEPAGE);
+#endif
+#else
+		void *p = malloc(b.size);
+#endif
+		if (!p)
+		{
+			printf("\n mesh arena: out of memory for %ld bytes", (long)b.size);
+			exit(EXIT_FAILURE);
+		}
+		b.base = (char *)p;
+		stats.systemAllocations++;
+		stats.capacity += b.size;
+		return b;
+	}
+
+	void unmap(const Block &b)
+	{
+#if defined(__unix__)
+		munmap(b.base, b.size);
+#else
+		free(b.base);
+#endif
+		stats.capacity -= b.size;
+	}
+
+public:
+	struct Stats
+	{
+		size_t allocations;		  // allocate() calls since the last reset
+		size_t bytes;			  // bytes handed out since the last reset
+		size_t peak;			  // most bytes handed out between two resets
+		size_t capacity;		  // bytes currently mapped
+		size_t systemAllocations; // blocks mapped from the system, ever
+		size_t resets;
+	} stats;
+	bool hugePages; // advise transparent huge pages for blocks of 2 MB and more
+
+	MeshArena() : used(0), hugePages(false)
+	{
+		Stats zero = {0, 0, 0, 0, 0, 0};
+		stats = zero;
+	}
+	~MeshArena()
+	{
+		for (size_t i = 0; i < blocks.size(); i++)
+			unmap(blocks[i]);
+	}
+
+	// make sure the next `bytes` of allocations fit in the current block
+	void reserve(size_t bytes)
+	{
+		if (!blocks.empty() && blocks.back().size - used >= bytes)
+			return;
+		blocks.push_back(map(std::max(bytes, MinBlock)));
+		used = 0;
+	}
+
+	void *allocate(size_t bytes, size_t align = 16)
+	{
+		size_t at = blocks.empty() ? 0 : (used + align - 1) & ~(align - 1);
+		if (blocks.empty() || at + bytes > blocks.back().size)
+		{
+			reserve(std::max(bytes, blocks.empty() ? 0 : 2 * blocks.back().size));
+			at = 0;
+		}
+		used = at + bytes;
+		stats.allocations++;
+		stats.bytes += bytes;
+		stats.peak = std::max(stats.peak, stats.bytes);
+		return blocks.back().base + at;
+	}
+
+	// drop every allocation; the memory is kept for the next generation, which will need about `expected` bytes
+	void reset(size_t expected = 0)
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < blocks.size(); i++)
+			total += blocks[i].size;
+		if (blocks.size() > 1 || total < expected)
+		{
+			for (size_t i = 0; i < blocks.size(); i++)
+				unmap(blocks[i]);
+			blocks.clear();
+			blocks.push_back(map(std::max(total, expected)));
+		}
+		used = 0;
+		stats.allocations = 0;
+		stats.bytes = 0;
+		stats.resets++;
+	}
+
+	void print(const char *name) const
+	{
+		printf("%s arena: %d allocations, %.1f MB used, %.1f MB peak, %.1f MB mapped in %d system allocations\n", name,
+			   (int)stats.allocations, stats.bytes / 1048576.0, stats.peak / 1048576.0, stats.capacity / 1048576.0,
+			   (int)stats.systemAllocations);
+	}
+};
+
+// STL allocator drawing from a MeshArena, or from the heap without one
+template <class T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+	MeshArena *arena;
+
+	ArenaAllocator(MeshArena *arena = NULL) : arena(arena) {}
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+	T *allocate(size_t n)
+	{
+		if (arena)
+			return (T *)arena->allocate(n * sizeof(T), alignof(T) < 16 ? 16 : alignof(T));
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T *p, size_t n)
+	{
+		if (!arena) // arena memory is released by reset()
+			std::allocator<T>().deallocate(p, n);
+	}
+
+	template <class U>
+	bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+	template <class U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
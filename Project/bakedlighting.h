@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- bakedlighting.h ---
+//
+//  Lighting evaluated once per vertex and kept in a buffer until it changes
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <stddef.h>
+
+//----------------------------------------------------------------------------
+//
+//  The sphere and the view stay put, and the lights only move on key
+//  presses and menu picks, so most frames light every fragment the same way
+//  as the frame before. With baked lighting, the BAKED shader variants run
+//  once over the vertices of the sphere with Baking set and the rasterizer
+//  off. Their vertex shader lights each vertex, and transform feedback
+//  keeps the two colors it outputs: the diffuse light, which the draw
+//  multiplies by the instance color, and the ambient and specular light.
+//  Frames in between read the colors back as vertex attributes. The vertex
+//  shader only places the vertex, and the fragment shader only writes the
+//  interpolated color.
+//
+//  A bake is keyed by everything its colors depend on, and redone when any
+//  of that changes. The colors belong to the vertices of the unit sphere,
+//  which is where the instances take theirs from: that is exact for
+//  directional lights, which light every instance alike, but not for point
+//  lights, so instances under point lights are lit per fragment instead.
+//
+
+const GLsizei BakedVaryings = 2;
+const char *const BakedVaryingNames[BakedVaryings] = {"bakedDiffuse", "bakedRest"}; // as the vertex shader has them
+
+// what the transform feedback writes for each vertex
+struct BakedVertex
+{
+	vec4 diffuse; // sum over the lights of Kd * DiffuseProduct
+	vec4 rest;	  // AmbientProduct plus the specular light
+};
+
+// what a bake depends on
+struct BakeKey
+{
+	int variant;	   // variantKey() of the program
+	GLuint program;	   // that baked, which a shader reload replaces under the same variant
+	int mesh;		   // buffers the vertices came from
+	GLsizei vertices;  // how many
+	unsigned uploads;  // of the sphere buffers, so far
+	unsigned lighting; // LightingUniforms::revision()
+};
+
+class LightBaker
+{
+	GLuint buffer;
+	GLsizeiptr capacity; // bytes of the buffer
+	BakeKey baked;
+	bool valid; // baked holds the key of the buffer contents
+
+public:
+	LightBaker() : buffer(0), capacity(0), valid(false) {}
+
+	void create() { glGenBuffers(1, &buffer); }
+
+	// the buffer holds the colors of this key already
+	bool current(const BakeKey &key) const { return valid && memcmp(&key, &baked, sizeof(key)) == 0; }
+
+	// run the current program, which has to capture BakedVaryingNames interleaved, over the first key.vertices
+	// vertices of the bound arrays, and keep what it outputs. The baked attributes have to be off meanwhile:
+	// the buffer cannot be read while it is written
+	void bake(GLStateCache &gl, const BakeKey &key)
+	{
+		GLsizeiptr bytes = key.vertices * GLsizeiptr(sizeof(BakedVertex));
+		if (bytes > capacity)
+		{
+			gl.bindBuffer(GL_ARRAY_BUFFER, buffer);
+			glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_DYNAMIC_COPY);
+			capacity = bytes;
+		}
+		glEnable(GL_RASTERIZER_DISCARD);
+		gl.bindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, key.vertices);
+		glEndTransformFeedback();
+		gl.bindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		baked = key;
+		valid = true;
+	}
+
+	// point the two attributes at the baked colors, or turn them off
+	void bindAttribs(GLStateCache &gl, GLuint diffuse, GLuint rest, bool enable)
+	{
+		gl.enableAttrib(diffuse, enable);
+		gl.enableAttrib(rest, enable);
+		if (!enable)
+			return;
+		gl.bindBuffer(GL_ARRAY_BUFFER, buffer);
+		gl.attribPointer(diffuse, 4, GL_FLOAT, GL_FALSE, sizeof(BakedVertex),
+						 (const GLvoid *)offsetof(BakedVertex, diffuse));
+		gl.attribPointer(rest, 4, GL_FLOAT, GL_FALSE, sizeof(BakedVertex), (const GLvoid *)offsetof(BakedVertex, rest));
+	}
+};
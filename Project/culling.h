@@ -0,0 +1,218 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- culling.h ---
+//
+//  View frustum culling of many bounding spheres, four at a time
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  The bounding spheres are kept as a structure of arrays (all x, then all
+//  y, z and radii), so one SSE load brings the same coordinate of four
+//  spheres and each plane is tested against four spheres with a handful of
+//  instructions. The survivors are compacted into a list of indices
+//  without branches: every lane writes its index and the output only
+//  advances for the visible ones.
+//
+//  On top of that sits one coarse level: the spheres are sorted along a
+//  Z-order curve so that each run of CullingBlock of them is compact, and
+//  each run gets a bounding box. A run entirely outside a plane is
+//  skipped and one entirely inside all of them is taken whole, so only the
+//  runs crossing the border of the view are tested sphere by sphere.
+//
+//  The arrays are padded to a multiple of four with spheres of negative
+//  radius, which are outside every plane.
+//
+
+const size_t CullingBlock = 64; // spheres under one bounding box of the coarse level, a multiple of 4
+
+struct CullingBox
+{
+	vec3 center, extent; // extent is half the size
+};
+
+struct SphereBounds
+{
+	std::vector<GLfloat> x, y, z, radius;
+	std::vector<CullingBox> blocks; // bounding box of each run of CullingBlock spheres
+	size_t count;					// spheres, not counting the padding
+
+	size_t padded() const { return x.size(); }
+};
+
+// spread the low 10 bits of v to every third bit
+inline uint32_t spreadBits(uint32_t v)
+{
+	v &= 0x3ff;
+	v = (v | v << 16) & 0x030000ff;
+	v = (v | v << 8) & 0x0300f00f;
+	v = (v | v << 4) & 0x030c30c3;
+	v = (v | v << 2) & 0x09249249;
+	return v;
+}
+
+// sort the instances along a Z-order curve through their bounding box, so that neighbours in the list are
+// neighbours in space
+inline void sortSpatially(std::vector<SphereInstance> &instances)
+{
+	if (instances.empty())
+		return;
+	vec3 low(1e30f, 1e30f, 1e30f), high(-1e30f, -1e30f, -1e30f);
+	for (size_t i = 0; i < instances.size(); i++)
+		for (int c = 0; c < 3; c++)
+		{
+			low[c] = std::min(low[c], instances[i].offsetScale[c]);
+			high[c] = std::max(high[c], instances[i].offsetScale[c]);
+		}
+	std::vector<std::pair<uint32_t, size_t>> keys(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		uint32_t key = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			GLfloat extent = high[c] - low[c];
+			uint32_t cell = extent > 0 ? uint32_t((instances[i].offsetScale[c] - low[c]) / extent * 1023) : 0;
+			key |= spreadBits(cell) << c;
+		}
+		keys[i] = std::make_pair(key, i);
+	}
+	std::sort(keys.begin(), keys.end());
+	std::vector<SphereInstance> sorted(instances.size());
+	for (size_t i = 0; i < keys.size(); i++)
+		sorted[i] = instances[keys[i].second];
+	instances.swap(sorted);
+}
+
+// fill the bounds from the instances, best sorted with sortSpatially first
+inline void setSphereBounds(SphereBounds &bounds, const SphereInstance *instances, size_t count)
+{
+	size_t padded = (count + 3) & ~size_t(3);
+	bounds.count = count;
+	bounds.x.assign(padded, 0);
+	bounds.y.assign(padded, 0);
+	bounds.z.assign(padded, 0);
+	bounds.radius.assign(padded, -1e30f);
+	for (size_t i = 0; i < count; i++)
+	{
+		bounds.x[i] = instances[i].offsetScale.x;
+		bounds.y[i] = instances[i].offsetScale.y;
+		bounds.z[i] = instances[i].offsetScale.z;
+		bounds.radius[i] = instances[i].offsetScale.w;
+	}
+
+	bounds.blocks.clear();
+	for (size_t first = 0; first < count; first += CullingBlock)
+	{
+		vec3 low(1e30f, 1e30f, 1e30f), high(-1e30f, -1e30f, -1e30f);
+		for (size_t i = first; i < std::min(first + CullingBlock, count); i++)
+		{
+			vec3 center(bounds.x[i], bounds.y[i], bounds.z[i]);
+			for (int c = 0; c < 3; c++)
+			{
+				low[c] = std::min(low[c], center[c] - bounds.radius[i]);
+				high[c] = std::max(high[c], center[c] + bounds.radius[i]);
+			}
+		}
+		CullingBox box = {(low + high) / 2, (high - low) / 2};
+		bounds.blocks.push_back(box);
+	}
+}
+
+// the planes scaled to unit normals, so that a plane gives the signed distance of a point directly
+inline void normalizePlanes(const vec4 planes[6], vec4 unit[6])
+{
+	for (int i = 0; i < 6; i++)
+		unit[i] = planes[i] / length(vec3(planes[i].x, planes[i].y, planes[i].z));
+}
+
+// append the spheres from first to end (a multiple of 4) that reach into the view volume of the unit planes
+// to visible[n], and return the new n
+inline size_t cullSphereRange(const SphereBounds &bounds, const vec4 unit[6], size_t first, size_t end,
+							  GLuint *visible, size_t n)
+{
+#if defined(CULLING_SSE)
+	__m128 px[6], py[6], pz[6], pw[6];
+	for (int k = 0; k < 6; k++)
+	{
+		px[k] = _mm_set1_ps(unit[k].x);
+		py[k] = _mm_set1_ps(unit[k].y);
+		pz[k] = _mm_set1_ps(unit[k].z);
+		pw[k] = _mm_set1_ps(unit[k].w);
+	}
+	for (size_t i = first; i < end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&bounds.x[i]);
+		__m128 y = _mm_loadu_ps(&bounds.y[i]);
+		__m128 z = _mm_loadu_ps(&bounds.z[i]);
+		__m128 reach = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i])); // least distance still in
+		__m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < 6; k++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, px[k]), _mm_mul_ps(y, py[k])),
+										 _mm_add_ps(_mm_mul_ps(z, pz[k]), pw[k]));
+			in = _mm_and_ps(in, _mm_cmpge_ps(distance, reach));
+		}
+		int mask = _mm_movemask_ps(in);
+		visible[n] = GLuint(i);
+		n += mask & 1;
+		visible[n] = GLuint(i + 1);
+		n += (mask >> 1) & 1;
+		visible[n] = GLuint(i + 2);
+		n += (mask >> 2) & 1;
+		visible[n] = GLuint(i + 3);
+		n += (mask >> 3) & 1;
+	}
+#else
+	for (size_t i = first; i < end; i++)
+	{
+		bool in = true;
+		for (int k = 0; k < 6; k++)
+			in &= unit[k].x * bounds.x[i] + unit[k].y * bounds.y[i] + unit[k].z * bounds.z[i] + unit[k].w >=
+				  -bounds.radius[i];
+		visible[n] = GLuint(i);
+		n += in;
+	}
+#endif
+	return n;
+}
+
+// write the indices of the spheres that reach into the view volume of the planes to `visible`, which holds
+// bounds.padded() entries, and return how many there are
+inline size_t cullSpheres(const SphereBounds &bounds, const vec4 planes[6], GLuint *visible)
+{
+	vec4 unit[6];
+	normalizePlanes(planes, unit);
+	size_t n = 0;
+	for (size_t b = 0; b < bounds.blocks.size(); b++)
+	{
+		const CullingBox &box = bounds.blocks[b];
+		bool inside = true, outside = false;
+		for (int k = 0; k < 6; k++)
+		{
+			GLfloat distance = dot(vec3(unit[k].x, unit[k].y, unit[k].z), box.center) + unit[k].w;
+			GLfloat reach = fabs(unit[k].x) * box.extent.x + fabs(unit[k].y) * box.extent.y +
+							fabs(unit[k].z) * box.extent.z; // of the box corner farthest along the normal
+			outside |= distance < -reach;
+			inside &= distance >= reach;
+		}
+		size_t first = b * CullingBlock;
+		if (outside)
+			continue;
+		if (inside)
+			for (size_t i = first; i < std::min(first + CullingBlock, bounds.count); i++)
+				visible[n++] = GLuint(i);
+		else
+			n = cullSphereRange(bounds, unit, first, std::min(first + CullingBlock, bounds.padded()), visible, n);
+	}
+	return n;
+}
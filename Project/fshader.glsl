@@ -1,30 +1,124 @@
 #version 130
+#extension GL_ARB_uniform_buffer_object : require
+// compiled once per variant, with DIRECTIONAL_LIGHT, SPECULAR, NUM_LIGHTS, IMPOSTOR, TILED_LIGHTS and BAKED
+// defined as for the vertex shader
 // per-fragment interpolated values from the vertex shader
+#ifdef BAKED
+in vec4 fBaked; // lit by the vertex shader
+#else
+#ifdef IMPOSTOR
+in vec2 fCorner; // position on the quad, in units of the radius
+flat in vec4 fSphere; // center and radius in object coordinates
+flat in vec4 fEyeSphere; // center and radius in eye coordinates
+uniform mat4 ModelView; // ModelView matrix
+uniform mat4 Projection; // Projection matrix
+#else
 in vec3 fN; // Normal vector
-in vec3 fL; // Light vector
+#ifdef SPECULAR
 in vec3 fE; // View vector
+#endif
+#ifndef DIRECTIONAL_LIGHT
+in vec3 fL[NUM_LIGHTS]; // Light vectors
+#endif
+#endif
+in vec4 fDiffuse; // diffuse color of the instance
+#endif
 out vec4 fColor; // output goes to the rasterizer
-uniform vec4 AmbientProduct, DiffuseProduct, SpecularProduct; // lighting products for each vertex
-uniform float Shininess; // shininess exponent for the material
+layout(std140) uniform Lighting { // light and material values, shared with the vertex shader
+    vec4 AmbientProduct, DiffuseProduct, SpecularProduct; // lighting products for each vertex
+    vec4 LightPosition[4]; // Light positions, or unit directions for directional lights
+    float Shininess; // shininess exponent for the material
+};
+
+#ifdef TILED_LIGHTS
+#ifndef IMPOSTOR
+in vec3 fEyePosition; // position in eye coordinates
+#endif
+// point lights binned into screen tiles, see tiledlights.h
+uniform sampler2D TiledLights; // two texels per light: eye position and radius, color
+uniform usampler2D LightTiles; // one texel per tile: first entry and count
+uniform usampler2D LightEntries; // light numbers of every tile, back to back
+const int LightTile = 16; // pixels on a side of a tile
+
+// texel i of the lights or the entries, which are 1024 texels to a row
+ivec2 lightTexel(int i) {
+    return ivec2(i & 1023, i >> 10);
+}
+#endif
 
 // main function: compute the color of the fragment
-// I = Ka * La + Kd * Ld * max(N . L, 0) + Ks * Ls * max(N . H, 0)^Shininess
+// I = Ka * La + sum over the lights of Kd * Ld * max(N . L, 0) + Ks * Ls * max(N . H, 0)^Shininess
 void main() {
+#ifdef BAKED
+    fColor = fBaked;
+#else
+#ifdef IMPOSTOR
+    // the view ray through the fragment runs along -z, so it meets the sphere where the corner lifts off the quad
+    float d2 = dot(fCorner, fCorner);
+    if(d2 > 1.0)
+        discard;
+    vec3 N = vec3(fCorner, sqrt(1.0 - d2)); // Normal vector in eye coordinates, unit already
+    vec3 eyePosition = fEyeSphere.xyz + fEyeSphere.w * N;
+    vec4 clip = Projection * vec4(eyePosition, 1.0);
+    gl_FragDepth = (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+#ifdef SPECULAR
+    vec3 E = normalize(-eyePosition);
+#endif
+#ifdef TILED_LIGHTS
+    vec3 fEyePosition = eyePosition;
+#endif
+#ifndef DIRECTIONAL_LIGHT
+    vec3 position = fSphere.xyz + fSphere.w * normalize(transpose(mat3(ModelView)) * N); // in object coordinates
+#endif
+#else
     // Normalize the input lighting vectors
     vec3 N = normalize(fN);
+#ifdef SPECULAR
     vec3 E = normalize(fE);
-    vec3 L = normalize(fL);
-    vec3 H = normalize(L + E);
-    vec4 ambient = AmbientProduct;
-    float Kd = max(dot(L, N), 0.0);
-    vec4 diffuse = Kd * DiffuseProduct;
-    float Ks = pow(max(dot(N, H), 0.0), Shininess);
-    vec4 specular = Ks * SpecularProduct;
-    // discard the specular highlight if the light's behind the vertex
-    if(dot(L, N) < 0.0) {
-        specular = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
+#endif
+    fColor = AmbientProduct;
+    for(int i = 0; i < NUM_LIGHTS; i++) {
+#if defined(DIRECTIONAL_LIGHT)
+        vec3 L = LightPosition[i].xyz; // the same for every fragment, and normalized already
+#elif defined(IMPOSTOR)
+        vec3 L = normalize(LightPosition[i].xyz - position);
+#else
+        vec3 L = normalize(fL[i]);
+#endif
+        float Kd = max(dot(L, N), 0.0);
+        fColor += Kd * DiffuseProduct * fDiffuse;
+#ifdef SPECULAR
+        // no specular highlight if the light's behind the vertex
+        if(dot(L, N) >= 0.0) {
+            vec3 H = normalize(L + E);
+            fColor += pow(max(dot(N, H), 0.0), Shininess) * SpecularProduct;
+        }
+#endif
+    }
+#ifdef TILED_LIGHTS
+    // only the lights whose radius reaches into this tile; each fades out quadratically towards its radius
+    uvec2 range = texelFetch(LightTiles, ivec2(gl_FragCoord.xy) / LightTile, 0).xy;
+    for(int e = int(range.x); e < int(range.x + range.y); e++) {
+        int light = int(texelFetch(LightEntries, lightTexel(e), 0).r);
+        vec4 positionRadius = texelFetch(TiledLights, lightTexel(2 * light), 0);
+        vec3 toLight = positionRadius.xyz - fEyePosition;
+        float d = length(toLight);
+        if(d >= positionRadius.w)
+            continue;
+        vec4 color = texelFetch(TiledLights, lightTexel(2 * light + 1), 0);
+        float falloff = (1.0 - d / positionRadius.w) * (1.0 - d / positionRadius.w);
+        vec3 L = toLight / max(d, 1e-6);
+        float Kd = max(dot(L, N), 0.0);
+        fColor += falloff * Kd * color * fDiffuse;
+#ifdef SPECULAR
+        if(dot(L, N) >= 0.0) {
+            vec3 H = normalize(L + E);
+            fColor += falloff * pow(max(dot(N, H), 0.0), Shininess) * color;
+        }
+#endif
     }
-    fColor = specular + diffuse + ambient; // set the fragment color
+#endif
     fColor.a = 1.0; // set the alpha value to 1.0
-   // gl_FragColor=specular+diffuse+ambient;// +  + ;
+#endif
 }
@@ -0,0 +1,238 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- glstate.h ---
+//
+//  Shadow copy of the GL state that drops calls which would change nothing
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <unordered_map>
+#include <string.h>
+#include <stdint.h>
+
+//----------------------------------------------------------------------------
+//
+//  GLStateCache - the program, buffer bindings, vertex attributes and
+//  uniform values last set through it
+//
+//  A call that would set what is already set is counted and dropped; any
+//  other is passed on to GL and remembered. This only holds while every
+//  change to that state goes through the cache: code that calls GL
+//  directly has to call invalidate() afterwards. Deleting buffers through
+//  it forgets every binding and attribute pointer into them, since GL may
+//  hand the names out again.
+//
+
+class GLStateCache
+{
+	static const GLuint Unknown = GLuint(-1);
+	static const int MaxAttribs = 16;
+
+	struct Attrib
+	{
+		GLint enabled; // -1 when unknown
+		GLuint divisor;
+		GLuint buffer; // of the pointer
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+		GLsizei stride;
+		const GLvoid *pointer;
+		GLfloat value[4]; // constant value while the array is disabled
+		bool valueKnown;
+	};
+
+	GLuint program;
+	GLuint arrayBuffer, elementBuffer, uniformBuffer;
+	Attrib attribs[MaxAttribs];
+	std::unordered_map<uint64_t, std::vector<GLfloat>> uniforms; // by program << 32 | location
+
+	// count the call, and tell whether it can be dropped
+	bool redundant(bool same)
+	{
+		if (same)
+			counters.skipped++;
+		else
+			counters.issued++;
+		return same;
+	}
+
+	// remember the value of a uniform of the current program; true if it had it already
+	bool sameUniform(GLint location, const void *value, size_t bytes)
+	{
+		if (location < 0) // GL ignores it anyway
+			return redundant(true);
+		std::vector<GLfloat> &known = uniforms[uint64_t(program) << 32 | uint32_t(location)];
+		size_t floats = (bytes + sizeof(GLfloat) - 1) / sizeof(GLfloat);
+		if (redundant(known.size() == floats && memcmp(&known[0], value, bytes) == 0))
+			return true;
+		known.resize(floats);
+		memcpy(&known[0], value, bytes);
+		return false;
+	}
+
+public:
+	struct Counters
+	{
+		size_t issued;	// calls passed on to GL
+		size_t skipped; // calls dropped because they changed nothing
+	} counters;
+
+	GLStateCache() { invalidate(); }
+
+	// forget everything, after GL was called around the cache
+	void invalidate()
+	{
+		program = Unknown;
+		arrayBuffer = elementBuffer = uniformBuffer = Unknown;
+		for (int i = 0; i < MaxAttribs; i++)
+		{
+			attribs[i].enabled = -1;
+			attribs[i].divisor = Unknown;
+			attribs[i].buffer = Unknown;
+			attribs[i].valueKnown = false;
+		}
+		uniforms.clear();
+		resetCounters();
+	}
+
+	void resetCounters()
+	{
+		counters.issued = 0;
+		counters.skipped = 0;
+	}
+
+	void useProgram(GLuint p)
+	{
+		if (redundant(p == program))
+			return;
+		program = p;
+		glUseProgram(p);
+	}
+
+	// delete the program and forget its uniforms, since GL may hand the name out again
+	void deleteProgram(GLuint p)
+	{
+		for (std::unordered_map<uint64_t, std::vector<GLfloat>>::iterator i = uniforms.begin(); i != uniforms.end();)
+			if (i->first >> 32 == p)
+				i = uniforms.erase(i);
+			else
+				++i;
+		if (program == p)
+			program = Unknown;
+		glDeleteProgram(p);
+	}
+
+	void bindBuffer(GLenum target, GLuint buffer)
+	{
+		GLuint &bound = target == GL_ELEMENT_ARRAY_BUFFER ? elementBuffer
+						: target == GL_UNIFORM_BUFFER ? uniformBuffer : arrayBuffer;
+		if (target != GL_ARRAY_BUFFER && target != GL_ELEMENT_ARRAY_BUFFER && target != GL_UNIFORM_BUFFER) // not shadowed
+			redundant(false);
+		else if (redundant(buffer == bound))
+			return;
+		else
+			bound = buffer;
+		glBindBuffer(target, buffer);
+	}
+
+	// bind the buffer to an indexed binding point of the target, which also binds it to the target itself
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		redundant(false);
+		if (target == GL_UNIFORM_BUFFER)
+			uniformBuffer = buffer;
+		glBindBufferBase(target, index, buffer);
+	}
+
+	void deleteBuffers(GLsizei n, const GLuint *buffers)
+	{
+		for (GLsizei i = 0; i < n; i++)
+		{
+			if (arrayBuffer == buffers[i])
+				arrayBuffer = 0;
+			if (elementBuffer == buffers[i])
+				elementBuffer = 0;
+			if (uniformBuffer == buffers[i])
+				uniformBuffer = 0;
+			for (int a = 0; a < MaxAttribs; a++)
+				if (attribs[a].buffer == buffers[i])
+					attribs[a].buffer = Unknown;
+		}
+		glDeleteBuffers(n, buffers);
+	}
+
+	void enableAttrib(GLuint index, bool enable)
+	{
+		Attrib &a = attribs[index];
+		if (redundant(a.enabled == GLint(enable)))
+			return;
+		a.enabled = enable;
+		a.valueKnown = false; // GL leaves the constant value undefined after the array was used
+		if (enable)
+			glEnableVertexAttribArray(index);
+		else
+			glDisableVertexAttribArray(index);
+	}
+
+	void attribDivisor(GLuint index, GLuint divisor)
+	{
+		if (redundant(attribs[index].divisor == divisor))
+			return;
+		attribs[index].divisor = divisor;
+		glVertexAttribDivisor(index, divisor);
+	}
+
+	// point the attribute into the buffer bound to GL_ARRAY_BUFFER
+	void attribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+					   const GLvoid *pointer)
+	{
+		Attrib &a = attribs[index];
+		if (redundant(a.buffer == arrayBuffer && arrayBuffer != Unknown && a.size == size && a.type == type &&
+					  a.normalized == normalized && a.stride == stride && a.pointer == pointer))
+			return;
+		a.buffer = arrayBuffer;
+		a.size = size;
+		a.type = type;
+		a.normalized = normalized;
+		a.stride = stride;
+		a.pointer = pointer;
+		glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+	}
+
+	void attrib4f(GLuint index, const vec4 &v)
+	{
+		Attrib &a = attribs[index];
+		if (redundant(a.valueKnown && memcmp(a.value, &v, sizeof(a.value)) == 0))
+			return;
+		memcpy(a.value, &v, sizeof(a.value));
+		a.valueKnown = true;
+		glVertexAttrib4f(index, v.x, v.y, v.z, v.w);
+	}
+
+	void uniform1i(GLint location, GLint v)
+	{
+		if (!sameUniform(location, &v, sizeof(v)))
+			glUniform1i(location, v);
+	}
+
+	void uniform1f(GLint location, GLfloat v)
+	{
+		if (!sameUniform(location, &v, sizeof(v)))
+			glUniform1f(location, v);
+	}
+
+	void uniform4fv(GLint location, const vec4 &v)
+	{
+		if (!sameUniform(location, &v, sizeof(v)))
+			glUniform4fv(location, 1, v);
+	}
+
+	// a row-major matrix, as mat4 keeps it
+	void uniformMatrix4fv(GLint location, const mat4 &m)
+	{
+		if (!sameUniform(location, &m, sizeof(m)))
+			glUniformMatrix4fv(location, 1, GL_TRUE, m);
+	}
+};
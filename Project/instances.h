@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- instances.h ---
+//
+//  Per-instance data for drawing many spheres with one instanced draw
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+//----------------------------------------------------------------------------
+//
+//  Every sphere of an instanced draw shares the vertex and element buffers
+//  of the unit sphere; what differs between them is a record in an
+//  instance buffer, read once per instance (attribute divisor 1). The
+//  vertex shader scales and moves the unit sphere by it and passes its
+//  color on as the diffuse color, so tens of thousands of spheres cost one
+//  draw call instead of one each.
+//
+
+struct SphereInstance
+{
+	vec4 offsetScale; // center in xyz, radius in w
+	vec4 color;		  // diffuse color
+};
+
+// small, fast generator so that a scene is the same on every run
+struct InstanceRandom
+{
+	uint32_t state;
+
+	InstanceRandom(uint32_t seed) : state(seed ? seed : 1) {}
+	// uniform in [0, 1)
+	GLfloat next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return GLfloat(state >> 8) / GLfloat(1 << 24);
+	}
+	GLfloat between(GLfloat low, GLfloat high) { return low + (high - low) * next(); }
+};
+
+// colors the instances are drawn in, like the elements of a molecule model
+const vec4 InstancePalette[] = {vec4(0.9, 0.2, 0.2, 1.0), vec4(0.2, 0.4, 0.9, 1.0), vec4(0.3, 0.8, 0.3, 1.0),
+								vec4(0.95, 0.85, 0.2, 1.0), vec4(0.6, 0.6, 0.6, 1.0), vec4(0.9, 0.5, 0.1, 1.0),
+								vec4(0.6, 0.3, 0.8, 1.0), vec4(0.2, 0.8, 0.8, 1.0)};
+const int InstanceColors = sizeof(InstancePalette) / sizeof(InstancePalette[0]);
+
+// `count` spheres of random palette colors scattered in the box from `low` to `high`, sized so that together they
+// fill about a tenth of it
+inline std::vector<SphereInstance> scatterSpheres(size_t count, const vec3 &low, const vec3 &high,
+												  uint32_t seed = 1)
+{
+	std::vector<SphereInstance> instances(count);
+	vec3 size = high - low;
+	GLfloat typical = GLfloat(cbrt(0.1 * size.x * size.y * size.z / (count * 4.18879))); // radius of a 10% fill
+	typical = std::min(typical, std::min(size.x, std::min(size.y, size.z)) / GLfloat(2.8)); // still fits the box
+	InstanceRandom random(seed);
+	for (size_t i = 0; i < count; i++)
+	{
+		GLfloat radius = typical * random.between(0.6, 1.4);
+		instances[i].offsetScale = vec4(random.between(low.x + radius, high.x - radius),
+										random.between(low.y + radius, high.y - radius),
+										random.between(low.z + radius, high.z - radius), radius);
+		instances[i].color = InstancePalette[std::min(int(random.next() * InstanceColors), InstanceColors - 1)];
+	}
+	return instances;
+}
@@ -0,0 +1,151 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- lighting.h ---
+//
+//  Light and material values of the shaders, kept in one uniform buffer
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <stddef.h>
+
+//----------------------------------------------------------------------------
+//
+//  Both shaders declare the same std140 uniform block, Lighting, with the
+//  three lighting products, the light positions and the shininess. Its
+//  values live in one uniform buffer attached to binding point
+//  LightingBinding, so they are set with one upload for every program that
+//  uses the block instead of a uniform call each, and nothing is looked up
+//  by name after the program is linked.
+//
+//  A directional light (w = 0) is stored normalized, so that the shaders
+//  can use it as it is.
+//
+//  The setters only change the CPU copy and mark it dirty when a value
+//  differs; flush() uploads it, at most once a frame. Every change also
+//  advances revision(), so that what is computed from the values can tell
+//  when it is out of date.
+//
+
+const GLuint LightingBinding = 0; // uniform buffer binding point of the Lighting block
+const int MaxLights = 4;		  // size of the LightPosition array of the block
+
+// the Lighting block in the std140 layout: vec4 members on 16-byte boundaries, and the block padded to a vec4
+struct LightingBlock
+{
+	vec4 ambientProduct;
+	vec4 diffuseProduct;
+	vec4 specularProduct;
+	vec4 lightPosition[MaxLights];
+	GLfloat shininess;
+	GLfloat padding[3];
+};
+
+class LightingUniforms
+{
+	LightingBlock block;
+	GLuint buffer;
+	GLsizeiptr bytes; // of the buffer, at least the largest block attached
+	bool dirty;
+	unsigned changes;
+
+	void set(vec4 &member, const vec4 &v)
+	{
+		if (memcmp(&member, &v, sizeof(v)) == 0)
+			return;
+		member = v;
+		dirty = true;
+		changes++;
+	}
+
+	// the members of the program's block sit where LightingBlock has them; the driver may pad the block
+	// beyond them, and members the program does not use are not asked about
+	static bool laidOut(GLuint program)
+	{
+		const GLsizei members = 5;
+		const char *names[members] = {"AmbientProduct", "DiffuseProduct", "SpecularProduct", "LightPosition[0]",
+									  "Shininess"};
+		const size_t offsets[members] = {offsetof(LightingBlock, ambientProduct),
+										 offsetof(LightingBlock, diffuseProduct),
+										 offsetof(LightingBlock, specularProduct),
+										 offsetof(LightingBlock, lightPosition), offsetof(LightingBlock, shininess)};
+		GLuint indices[members];
+		glGetUniformIndices(program, members, names, indices);
+		for (int m = 0; m < members; m++)
+		{
+			if (indices[m] == GL_INVALID_INDEX)
+				continue;
+			GLint offset = -1, stride = 0;
+			glGetActiveUniformsiv(program, 1, &indices[m], GL_UNIFORM_OFFSET, &offset);
+			glGetActiveUniformsiv(program, 1, &indices[m], GL_UNIFORM_ARRAY_STRIDE, &stride);
+			if (offset != GLint(offsets[m]) || (m == 3 && stride != GLint(sizeof(vec4))))
+				return false;
+		}
+		return true;
+	}
+
+public:
+	LightingUniforms() : block(), buffer(0), bytes(0), dirty(true), changes(0) {}
+
+	// attach the Lighting block of a just linked program to the buffer, creating or growing the buffer when
+	// the block needs it; false if the program has no such block, or places its members other than
+	// LightingBlock does
+	bool attach(GLStateCache &gl, GLuint program)
+	{
+		GLuint index = glGetUniformBlockIndex(program, "Lighting");
+		if (index == GL_INVALID_INDEX)
+			return false;
+		GLint size = 0;
+		glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+		if (size < GLint(sizeof(LightingBlock)) || !laidOut(program))
+			return false;
+		glUniformBlockBinding(program, index, LightingBinding);
+		if (buffer == 0)
+			glGenBuffers(1, &buffer);
+		if (size > bytes)
+		{
+			gl.bindBufferBase(GL_UNIFORM_BUFFER, LightingBinding, buffer);
+			glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW); // the whole block has to be backed
+			bytes = size;
+			dirty = true;
+		}
+		return true;
+	}
+
+	void setProducts(const vec4 &ambient, const vec4 &diffuse, const vec4 &specular)
+	{
+		set(block.ambientProduct, ambient);
+		set(block.diffuseProduct, diffuse);
+		set(block.specularProduct, specular);
+	}
+	void setDiffuseProduct(const vec4 &diffuse) { set(block.diffuseProduct, diffuse); }
+	void setLightPosition(int light, const vec4 &position)
+	{
+		if (position.w == 0 && length(vec3(position.x, position.y, position.z)) > 0)
+			set(block.lightPosition[light], vec4(normalize(vec3(position.x, position.y, position.z)), 0.0));
+		else
+			set(block.lightPosition[light], position);
+	}
+	void setShininess(GLfloat shininess)
+	{
+		if (block.shininess == shininess)
+			return;
+		block.shininess = shininess;
+		dirty = true;
+		changes++;
+	}
+
+	// number of changes to the values so far
+	unsigned revision() const { return changes; }
+
+	// upload the values if any changed since the last upload; true if they did
+	bool flush(GLStateCache &gl)
+	{
+		if (!dirty || buffer == 0)
+			return false;
+		gl.bindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+		dirty = false;
+		return true;
+	}
+};
@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- meshcache.h ---
+//
+//  Versioned, checksummed binary mesh files that are memory mapped on load
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  A mesh file holds a header and two blocks stored exactly as they go into
+//  the GL vertex and element buffers, so a loaded file is handed straight to
+//  glBufferData, and an optional block of cluster records (such as meshlet
+//  bounds) for its index ranges. The header keys the file by format version,
+//  generator version, subdivision level and vertex layout; a file whose key
+//  or checksum does not match is stale and is rebuilt.
+//
+
+const uint32_t MeshCacheFormat = 2;
+const int MeshCacheMaxRanges = 16;
+
+struct MeshCacheKey
+{
+	uint32_t generator; // version of the code that produced the mesh
+	int32_t level;		// subdivision level
+	uint32_t layout;	// vertex layout of the vertex block
+	uint32_t indexType; // GL type of the indices in the element block
+
+	bool operator==(const MeshCacheKey &k) const
+	{
+		return generator == k.generator && level == k.level && layout == k.layout && indexType == k.indexType;
+	}
+};
+
+struct MeshCacheHeader
+{
+	char magic[8]; // "MESHCACH"
+	uint32_t format;
+	MeshCacheKey key;
+	uint64_t vertexBytes, elementBytes, clusterBytes;
+	uint32_t vertexCount;
+	uint32_t rangeCount;
+	uint64_t rangeOffset[MeshCacheMaxRanges];  // byte offset of each index range in the element block
+	uint32_t rangeIndices[MeshCacheMaxRanges]; // indices in each range
+	uint32_t rangeClusters[MeshCacheMaxRanges]; // cluster records of each range, back to back
+	uint64_t checksum;							// of the vertex, element and cluster blocks
+};
+
+// 64-bit hash of a block, a word at a time
+inline uint64_t meshChecksum(const char *data, uint64_t bytes, uint64_t h = 14695981039346656037ull)
+{
+	uint64_t i = 0;
+	for (; i + 8 <= bytes; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, data + i, 8);
+		h = (h ^ w) * 1099511628211ull;
+		h ^= h >> 29;
+	}
+	for (; i < bytes; i++)
+		h = (h ^ (unsigned char)data[i]) * 1099511628211ull;
+	return h;
+}
+
+// a mesh file opened for reading; the blocks stay valid until it is destroyed
+class MeshCacheFile
+{
+	char *data;
+	size_t size;
+	bool mapped;
+
+public:
+	MeshCacheHeader header;
+
+	MeshCacheFile() : data(NULL), size(0), mapped(false) {}
+	~MeshCacheFile() { close(); }
+
+	// map the file and check it against the key; false if it is missing or stale
+	bool open(const char *path, const MeshCacheKey &key)
+	{
+		close();
+#if defined(__unix__)
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(MeshCacheHeader))
+		{
+			size = st.st_size;
+			void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+			if (p != MAP_FAILED)
+			{
+				data = (char *)p;
+				mapped = true;
+			}
+		}
+		::close(fd);
+#else
+		FILE *fp = fopen(path, "rb");
+		if (!fp)
+			return false;
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		data = new char[size];
+		if (fread(data, 1, size, fp) != size)
+			size = 0;
+		fclose(fp);
+#endif
+		if (!data || size < sizeof(MeshCacheHeader))
+		{
+			close();
+			return false;
+		}
+
+		memcpy(&header, data, sizeof(header));
+		bool valid = memcmp(header.magic, "MESHCACH", 8) == 0 && header.format == MeshCacheFormat &&
+					 header.key == key && header.rangeCount <= MeshCacheMaxRanges &&
+					 sizeof(header) + header.vertexBytes + header.elementBytes + header.clusterBytes == size &&
+					 meshChecksum(clusters(), header.clusterBytes,
+								  meshChecksum(elements(), header.elementBytes,
+											   meshChecksum(vertices(), header.vertexBytes))) == header.checksum;
+		if (!valid)
+			close();
+		return valid;
+	}
+
+	void close()
+	{
+		if (!data)
+			return;
+#if defined(__unix__)
+		if (mapped)
+			munmap(data, size);
+#endif
+		if (!mapped)
+			delete[] data;
+		data = NULL;
+		size = 0;
+		mapped = false;
+	}
+
+	const char *vertices() const { return data + sizeof(MeshCacheHeader); }
+	const char *elements() const { return vertices() + header.vertexBytes; }
+	const char *clusters() const { return elements() + header.elementBytes; }
+};
+
+// write a mesh file from its vertex block (given in pieces, stored back to back), element block and cluster block;
+// it is written under a temporary name and renamed, so readers never see half a file
+inline bool writeMeshCache(const char *path, MeshCacheHeader header, const char *const *vertexPieces,
+						   const uint64_t *pieceBytes, int pieces, const char *elements, const char *clusters)
+{
+	memcpy(header.magic, "MESHCACH", 8);
+	header.format = MeshCacheFormat;
+	header.vertexBytes = 0;
+	uint64_t h = 14695981039346656037ull;
+	for (int i = 0; i < pieces; i++)
+	{
+		h = meshChecksum(vertexPieces[i], pieceBytes[i], h);
+		header.vertexBytes += pieceBytes[i];
+	}
+	// hashes the same as one block as long as every piece but the last is a multiple of 8 bytes
+	header.checksum = meshChecksum(clusters, header.clusterBytes, meshChecksum(elements, header.elementBytes, h));
+
+	std::string temporary = std::string(path) + ".tmp";
+	FILE *fp = fopen(temporary.c_str(), "wb");
+	if (!fp)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	for (int i = 0; ok && i < pieces; i++)
+		ok = fwrite(vertexPieces[i], 1, pieceBytes[i], fp) == pieceBytes[i];
+	ok = ok && fwrite(elements, 1, header.elementBytes, fp) == header.elementBytes;
+	ok = ok && (!header.clusterBytes || fwrite(clusters, 1, header.clusterBytes, fp) == header.clusterBytes);
+	ok = fclose(fp) == 0 && ok;
+	if (ok)
+		ok = rename(temporary.c_str(), path) == 0;
+	if (!ok)
+		remove(temporary.c_str());
+	return ok;
+}
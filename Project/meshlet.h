@@ -0,0 +1,196 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- meshlet.h ---
+//
+//  Meshlets: small triangle clusters with bounds for per-cluster culling
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <math.h>
+
+//----------------------------------------------------------------------------
+//
+//  A meshlet is a run of up to MeshletMaxTriangles triangles of an index
+//  list using at most MeshletMaxVertices vertices, grown from a seed across
+//  shared edges so it stays compact. Each carries a bounding sphere and a
+//  normal cone holding every face normal, which is enough to drop the whole
+//  meshlet on the CPU when it lies outside the view or faces away from the
+//  eye, before any of its vertices are shaded.
+//
+
+const int MeshletMaxVertices = 64;
+const int MeshletMaxTriangles = 124;
+
+struct Meshlet
+{
+	GLuint first, count; // triangles of the meshlet in the index list
+	vec3 center;		 // bounding sphere
+	GLfloat radius;
+	vec3 axis;		// normal cone: every face normal lies within the cone angle of the axis
+	GLfloat cutoff; // sin of the cone angle; 1 when the cone is too wide to ever face away
+};
+
+// the triangles of an index list in meshlet order, each meshlet in vertex cache order;
+// the triangle count of each meshlet is appended to sizes
+inline std::vector<GLuint> meshletOrder(const GLuint *indices, size_t triangles, size_t vertices,
+										std::vector<GLuint> &sizes)
+{
+	std::vector<size_t> first;
+	std::vector<GLuint> around;
+	trianglesAround(indices, triangles, vertices, first, around);
+
+	std::vector<char> taken(triangles, 0);
+	std::vector<GLuint> inMeshlet(vertices, GLuint(-1)); // meshlet that last used the vertex
+	std::vector<GLuint> candidate(triangles, GLuint(-1)); // meshlet the triangle is a candidate of
+	std::vector<GLuint> order, members, candidates, local;
+	order.reserve(triangles);
+	GLuint meshlet = 0;
+	int used = 0;
+
+	auto add = [&](GLuint t)
+	{
+		taken[t] = 1;
+		members.push_back(t);
+		for (int c = 0; c < 3; c++)
+		{
+			GLuint v = indices[3 * t + c];
+			if (inMeshlet[v] != meshlet)
+				inMeshlet[v] = meshlet, used++;
+			for (size_t j = first[v]; j < first[v + 1]; j++)
+				if (!taken[around[j]] && candidate[around[j]] != meshlet)
+				{
+					candidate[around[j]] = meshlet;
+					candidates.push_back(around[j]);
+				}
+		}
+	};
+
+	for (size_t seed = 0; seed < triangles; seed++)
+	{
+		if (taken[seed])
+			continue;
+		members.clear();
+		candidates.clear();
+		used = 0;
+		add(GLuint(seed));
+
+		// grow by the neighbour that shares the most vertices, so the meshlet stays round
+		while (members.size() < size_t(MeshletMaxTriangles))
+		{
+			long best = -1;
+			int bestShared = -1;
+			for (size_t i = 0; i < candidates.size();)
+			{
+				GLuint t = candidates[i];
+				if (taken[t])
+				{
+					candidates[i] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				int shared = (inMeshlet[indices[3 * t]] == meshlet) + (inMeshlet[indices[3 * t + 1]] == meshlet) +
+							 (inMeshlet[indices[3 * t + 2]] == meshlet);
+				if (used + 3 - shared <= MeshletMaxVertices && shared > bestShared)
+					best = i, bestShared = shared;
+				i++;
+			}
+			if (best < 0)
+				break;
+			GLuint t = candidates[best];
+			candidates[best] = candidates.back();
+			candidates.pop_back();
+			add(t);
+		}
+
+		// keep the vertex cache order inside the meshlet
+		local.resize(3 * members.size());
+		std::vector<GLuint> number; // local number of each vertex, by order of use
+		for (size_t i = 0; i < local.size(); i++)
+		{
+			GLuint v = indices[3 * members[i / 3] + i % 3];
+			size_t n = std::find(number.begin(), number.end(), v) - number.begin();
+			if (n == number.size())
+				number.push_back(v);
+			local[i] = GLuint(n);
+		}
+		std::vector<GLuint> fan = tipsifyOrder(&local[0], members.size(), number.size());
+		for (size_t i = 0; i < fan.size(); i++)
+			order.push_back(members[fan[i]]);
+		sizes.push_back(GLuint(members.size()));
+		meshlet++;
+	}
+	return order;
+}
+
+// bounding sphere and normal cone of the triangles [first, first + count) of an index list
+inline Meshlet meshletBounds(const GLuint *indices, const vec4 *points, GLuint first, GLuint count)
+{
+	Meshlet m;
+	m.first = first;
+	m.count = count;
+	vec3 sum(0.0, 0.0, 0.0), normals(0.0, 0.0, 0.0);
+	for (GLuint t = first; t < first + count; t++)
+	{
+		vec3 p[3];
+		for (int c = 0; c < 3; c++)
+		{
+			const vec4 &q = points[indices[3 * t + c]];
+			p[c] = vec3(q.x, q.y, q.z);
+			sum += p[c];
+		}
+		normals += normalize(cross(p[1] - p[0], p[2] - p[0]));
+	}
+	m.center = sum / GLfloat(3 * count);
+	m.radius = 0;
+	for (GLuint i = 3 * first; i < 3 * (first + count); i++)
+	{
+		const vec4 &q = points[indices[i]];
+		m.radius = std::max(m.radius, length(vec3(q.x, q.y, q.z) - m.center));
+	}
+
+	m.axis = length(normals) > 0 ? normalize(normals) : vec3(0.0, 0.0, 1.0);
+	GLfloat spread = 1; // cos of the widest angle between the axis and a face normal
+	for (GLuint t = first; t < first + count; t++)
+	{
+		vec3 p[3];
+		for (int c = 0; c < 3; c++)
+			p[c] = vec3(points[indices[3 * t + c]].x, points[indices[3 * t + c]].y, points[indices[3 * t + c]].z);
+		spread = std::min(spread, dot(m.axis, normalize(cross(p[1] - p[0], p[2] - p[0]))));
+	}
+	m.cutoff = spread <= 0 ? 1 : sqrt(1 - spread * spread);
+	return m;
+}
+
+// the meshlet faces away from the eye, given in object space as a position (w = 1) or, for orthographic
+// views, as the direction toward the viewer (w = 0)
+inline bool meshletBackFacing(const Meshlet &m, const vec4 &eye)
+{
+	if (m.cutoff >= 1)
+		return false;
+	if (eye.w == 0)
+		return dot(m.axis, vec3(eye.x, eye.y, eye.z)) <= -m.cutoff;
+	vec3 toCenter = m.center - vec3(eye.x, eye.y, eye.z);
+	return dot(toCenter, m.axis) >= m.cutoff * length(toCenter) + m.radius;
+}
+
+// the six planes of the view volume of a projection * model view matrix, in object space
+inline void frustumPlanes(const mat4 &mvp, vec4 planes[6])
+{
+	for (int i = 0; i < 3; i++)
+	{
+		planes[2 * i] = mvp[3] + mvp[i];
+		planes[2 * i + 1] = mvp[3] - mvp[i];
+	}
+}
+
+inline bool meshletOutside(const Meshlet &m, const vec4 planes[6])
+{
+	for (int i = 0; i < 6; i++)
+	{
+		vec3 n(planes[i].x, planes[i].y, planes[i].z);
+		if (dot(n, m.center) + planes[i].w < -m.radius * length(n))
+			return true;
+	}
+	return false;
+}
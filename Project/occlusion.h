@@ -0,0 +1,253 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- occlusion.h ---
+//
+//  Low resolution CPU depth buffer for culling instances hidden by nearer ones
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  The nearest instances are drawn as occluders into a small depth buffer
+//  on the CPU, and every candidate is then tested against it before it is
+//  submitted. Both sides stay conservative. An occluder only writes the
+//  pixels that lie entirely inside its silhouette, each at the farthest
+//  depth its front surface reaches over the pixel. A candidate is tested
+//  with every pixel its silhouette touches at the depth of its nearest
+//  point, and it is hidden only if all of them are covered by something
+//  nearer.
+//
+//  As in masked occlusion culling, a hierarchical level of tiles keeps the
+//  farthest depth of each tile, so most candidates are settled a tile at a
+//  time and only the tiles they share with the border of an occluder are
+//  looked at pixel by pixel. The occluders are binned by bands of tile rows
+//  and each band is drawn on its own thread, four pixels at a time with
+//  SSE; the candidates are then tested on all threads.
+//
+//  Silhouettes are computed for views that are orthographic projections of
+//  a rotation, which is every view of this program; under other views
+//  nothing is culled.
+//
+
+const int OcclusionWidth = 512, OcclusionHeight = 512; // depth buffer resolution, over the whole viewport
+const int OcclusionTile = 8;						   // pixels on a side of a tile of the hierarchical level
+const int MaxOccluders = 16384;						   // nearest instances drawn as occluders
+
+// floor and ceil to int, without the library calls, which are not inlined for plain SSE2
+inline int floorPixel(GLfloat f)
+{
+	int i = int(f);
+	return i - (f < i);
+}
+inline int ceilPixel(GLfloat f)
+{
+	int i = int(f);
+	return i + (f > i);
+}
+
+// silhouette of a sphere on the depth buffer: an ellipse along the axes, in pixels, and the window depths
+// (0 near, 1 far) of its center and of its nearest point
+struct OcclusionDisk
+{
+	GLfloat x, y, rx, ry;
+	GLfloat depth, nearest;
+};
+
+// the silhouette of a sphere under an orthographic view; false under any other
+inline bool sphereDisk(const mat4 &mvp, const vec4 &sphere, OcclusionDisk &disk)
+{
+	if (mvp[3].x != 0 || mvp[3].y != 0 || mvp[3].z != 0 || mvp[3].w != 1)
+		return false;
+	vec3 row[3];
+	for (int i = 0; i < 3; i++)
+		row[i] = vec3(mvp[i].x, mvp[i].y, mvp[i].z);
+	for (int i = 0; i < 3; i++) // the screen axes are those of the view, only scaled
+		if (fabs(dot(row[i], row[(i + 1) % 3])) > 1e-4f * length(row[i]) * length(row[(i + 1) % 3]))
+			return false;
+
+	vec4 clip = mvp * vec4(sphere.x, sphere.y, sphere.z, 1.0);
+	disk.x = (clip.x * 0.5f + 0.5f) * OcclusionWidth;
+	disk.y = (clip.y * 0.5f + 0.5f) * OcclusionHeight;
+	disk.rx = sphere.w * length(row[0]) * 0.5f * OcclusionWidth;
+	disk.ry = sphere.w * length(row[1]) * 0.5f * OcclusionHeight;
+	disk.depth = clip.z * 0.5f + 0.5f;
+	disk.nearest = disk.depth - sphere.w * length(row[2]) * 0.5f;
+	return true;
+}
+
+class OcclusionBuffer
+{
+	std::vector<GLfloat> depth;	  // farthest depth each pixel is known to be covered at, 1 where nothing is
+	std::vector<GLfloat> tileMax; // farthest depth in each tile
+	std::vector<std::vector<GLuint>> bands; // occluders reaching into each band of tile rows
+
+	static const int TilesX = OcclusionWidth / OcclusionTile, TilesY = OcclusionHeight / OcclusionTile;
+
+	// the pixels of row y that the silhouette covers entirely (inside) or touches; false if there are none
+	static bool span(const OcclusionDisk &d, int y, bool inside, int &x0, int &x1)
+	{
+		GLfloat low = (y - d.y) / d.ry, high = (y + 1 - d.y) / d.ry; // the row in units of the radius
+		GLfloat v = inside ? std::max(fabs(low), fabs(high)) : (low > 0 ? low : high < 0 ? -high : 0);
+		if (v >= 1)
+			return false;
+		GLfloat half = d.rx * sqrt(1 - v * v);
+		x0 = std::max(0, inside ? ceilPixel(d.x - half) : floorPixel(d.x - half));
+		x1 = std::min(OcclusionWidth, inside ? floorPixel(d.x + half) : ceilPixel(d.x + half));
+		return x0 < x1;
+	}
+
+	// draw the covered pixels of row y of an occluder, each at the farthest depth of the front surface over it
+	void drawSpan(const OcclusionDisk &d, int y)
+	{
+		int x0, x1;
+		if (!span(d, y, true, x0, x1))
+			return;
+		GLfloat *row = &depth[y * OcclusionWidth];
+		GLfloat v = std::max(fabs(y - d.y), fabs(y + 1 - d.y)) / d.ry;
+		GLfloat reach = (d.nearest - d.depth); // negative
+		int x = x0;
+#if defined(OCCLUSION_SSE)
+		__m128 one = _mm_set1_ps(1), center = _mm_set1_ps(d.x), scale = _mm_set1_ps(1 / d.rx);
+		__m128 vv = _mm_set1_ps(v * v), z = _mm_set1_ps(d.depth), r = _mm_set1_ps(reach);
+		__m128 sign = _mm_set1_ps(-0.0f), step = _mm_set_ps(3, 2, 1, 0);
+		for (; x + 4 <= x1; x += 4)
+		{
+			__m128 left = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(GLfloat(x)), step), center);
+			__m128 u = _mm_mul_ps(_mm_max_ps(_mm_andnot_ps(sign, left), _mm_andnot_ps(sign, _mm_add_ps(left, one))),
+								  scale); // farthest corner of each pixel
+			__m128 front = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(u, u)), vv), _mm_setzero_ps()));
+			__m128 pixel = _mm_add_ps(z, _mm_mul_ps(r, front));
+			_mm_storeu_ps(row + x, _mm_min_ps(_mm_loadu_ps(row + x), pixel));
+		}
+#endif
+		for (; x < x1; x++)
+		{
+			GLfloat u = std::max(fabs(x - d.x), fabs(x + 1 - d.x)) / d.rx;
+			row[x] = std::min(row[x], d.depth + reach * GLfloat(sqrt(std::max(0.0f, 1 - u * u - v * v))));
+		}
+	}
+
+	// some pixel from x0 to x1 of a row is not in front of z
+	static bool spanReaches(const GLfloat *row, int x0, int x1, GLfloat z)
+	{
+		int x = x0;
+#if defined(OCCLUSION_SSE)
+		__m128 z4 = _mm_set1_ps(z);
+		for (; x + 4 <= x1; x += 4)
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z4)))
+				return true;
+#endif
+		for (; x < x1; x++)
+			if (row[x] >= z)
+				return true;
+		return false;
+	}
+
+public:
+	OcclusionBuffer() : depth(OcclusionWidth * OcclusionHeight, 1.0f), tileMax(TilesX * TilesY, 1.0f), bands(TilesY) {}
+
+	// clear the buffer and draw the occluders into it, a band of tile rows at a time on each thread
+	void draw(const std::vector<OcclusionDisk> &occluders, int threads)
+	{
+		for (int b = 0; b < TilesY; b++)
+			bands[b].clear();
+		for (size_t i = 0; i < occluders.size(); i++)
+		{
+			int top = std::max(0, int(occluders[i].y - occluders[i].ry) / OcclusionTile);
+			int bottom = std::min(TilesY - 1, int(occluders[i].y + occluders[i].ry) / OcclusionTile);
+			for (int b = top; b <= bottom; b++)
+				bands[b].push_back(GLuint(i));
+		}
+
+		parallelFor(TilesY, threads, [&](size_t band)
+					{
+			int top = int(band) * OcclusionTile, bottom = top + OcclusionTile;
+			std::fill(&depth[top * OcclusionWidth], &depth[bottom * OcclusionWidth], 1.0f);
+			for (size_t i = 0; i < bands[band].size(); i++)
+			{
+				const OcclusionDisk &d = occluders[bands[band][i]];
+				for (int y = std::max(top, int(d.y - d.ry)); y < std::min(bottom, int(d.y + d.ry) + 1); y++)
+					drawSpan(d, y);
+			}
+			for (int t = 0; t < TilesX; t++)
+			{
+				GLfloat farthest = 0;
+				for (int y = top; y < bottom; y++)
+					for (int x = t * OcclusionTile; x < (t + 1) * OcclusionTile; x++)
+						farthest = std::max(farthest, depth[y * OcclusionWidth + x]);
+				tileMax[band * TilesX + t] = farthest;
+			} });
+	}
+
+	// every pixel the silhouette touches is covered by something nearer than its nearest point
+	bool hidden(const OcclusionDisk &d) const
+	{
+		int y0 = std::max(0, floorPixel(d.y - d.ry)), y1 = std::min(OcclusionHeight, ceilPixel(d.y + d.ry));
+		int x0 = std::max(0, floorPixel(d.x - d.rx)), x1 = std::min(OcclusionWidth, ceilPixel(d.x + d.rx));
+		if (x0 >= x1 || y0 >= y1)
+			return false;
+		int cx = int(d.x), cy = int(d.y); // most candidates show at their center
+		if (cx >= 0 && cx < OcclusionWidth && cy >= 0 && cy < OcclusionHeight && depth[cy * OcclusionWidth + cx] >= d.nearest)
+			return false;
+		for (int ty = y0 / OcclusionTile; ty <= (y1 - 1) / OcclusionTile; ty++)
+			for (int tx = x0 / OcclusionTile; tx <= (x1 - 1) / OcclusionTile; tx++)
+			{
+				if (tileMax[ty * TilesX + tx] < d.nearest) // the whole tile is in front
+					continue;
+				int top = std::max(y0, ty * OcclusionTile), bottom = std::min(y1, (ty + 1) * OcclusionTile);
+				for (int y = top; y < bottom; y++)
+				{
+					int left, right;
+					if (span(d, y, false, left, right) &&
+						spanReaches(&depth[y * OcclusionWidth], std::max(left, tx * OcclusionTile),
+									std::min(right, (tx + 1) * OcclusionTile), d.nearest))
+						return false;
+				}
+			}
+		return true;
+	}
+};
+
+// drop the instances of visible[0, n) hidden behind the MaxOccluders nearest of them, keeping the order of
+// the rest; returns how many are left
+inline size_t cullOccluded(OcclusionBuffer &buffer, const mat4 &mvp, const SphereInstance *instances,
+						   GLuint *visible, size_t n, int threads)
+{
+	std::vector<OcclusionDisk> disks(n);
+	for (size_t i = 0; i < n; i++)
+		if (!sphereDisk(mvp, instances[visible[i]].offsetScale, disks[i]))
+			return n;
+
+	// the nearest instances that cover a pixel are the occluders
+	std::vector<OcclusionDisk> occluders;
+	for (size_t i = 0; i < n; i++)
+		if (disks[i].rx >= 1 && disks[i].ry >= 1)
+			occluders.push_back(disks[i]);
+	if (occluders.size() > size_t(MaxOccluders))
+	{
+		std::nth_element(occluders.begin(), occluders.begin() + MaxOccluders, occluders.end(),
+						 [](const OcclusionDisk &a, const OcclusionDisk &b)
+						 { return a.nearest < b.nearest; });
+		occluders.resize(MaxOccluders);
+	}
+	buffer.draw(occluders, threads);
+
+	std::vector<char> hidden(n);
+	parallelForChunks(n, 1024, threads, [&](size_t i)
+					  { hidden[i] = buffer.hidden(disks[i]); });
+	size_t kept = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		visible[kept] = visible[i];
+		kept += !hidden[i];
+	}
+	return kept;
+}
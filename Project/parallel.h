@@ -0,0 +1,58 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- parallel.h ---
+//
+//  Minimal thread pool helpers for splitting independent work across cores
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// number of worker threads to use when none is requested
+inline int hardwareThreads()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return n > 0 ? int(n) : 1;
+}
+
+// call f(i) for every i in [0, n) on up to `threads` threads; the calling thread works too
+template <class F>
+inline void parallelFor(size_t n, int threads, F f)
+{
+	if (threads > int(n))
+		threads = int(n);
+	if (threads <= 1)
+	{
+		for (size_t i = 0; i < n; i++)
+			f(i);
+		return;
+	}
+
+	std::atomic<size_t> next(0); // items are handed out one at a time, so uneven items balance out
+	auto work = [&]()
+	{
+		for (size_t i = next++; i < n; i = next++)
+			f(i);
+	};
+
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++)
+		pool.emplace_back(work);
+	work();
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+}
+
+// call f(i) for every i in [0, n) on up to `threads` threads, handing out `grain` items at a time
+template <class F>
+inline void parallelForChunks(size_t n, size_t grain, int threads, F f)
+{
+	parallelFor((n + grain - 1) / grain, threads, [&](size_t chunk)
+				{
+		size_t end = std::min(n, (chunk + 1) * grain);
+		for (size_t i = chunk * grain; i < end; i++)
+			f(i); });
+}
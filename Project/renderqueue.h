@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- renderqueue.h ---
+//
+//  Draws collected under sort keys and put in state order before they are issued
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <stdint.h>
+
+//----------------------------------------------------------------------------
+//
+//  Scene code pushes one item per draw, with a 64-bit key that packs the
+//  state the draw needs, most expensive to change first:
+//
+//      program index (8 bits) | mesh (8) | material (16) | depth (24)
+//
+//  Sorting the keys therefore groups the draws by program, then by mesh
+//  buffers, then by material, and draws each group front to back, so that
+//  the state cache sees as few changes as possible and early depth testing
+//  rejects what is hidden. The sort is a least significant digit radix sort
+//  on bytes, which skips the bytes that are the same in every key.
+//
+
+struct RenderItem
+{
+	uint64_t key;
+	GLuint object; // what to draw, for the caller
+};
+
+// sort key of a draw; program is a dense index below 256, not the GL name, which keeps growing as programs are
+// created; depth is the window depth of the object, 0 near to 1 far
+inline uint64_t renderKey(unsigned program, unsigned mesh, unsigned material, GLfloat depth)
+{
+	GLfloat d = depth < 0 ? 0 : depth > 1 ? 1 : depth;
+	return uint64_t(program & 0xff) << 56 | uint64_t(mesh & 0xff) << 48 | uint64_t(material & 0xffff) << 24 |
+		   uint64_t(d * 0xffffff);
+}
+
+class RenderQueue
+{
+	std::vector<RenderItem> scratch;
+
+public:
+	std::vector<RenderItem> items;
+
+	void clear() { items.clear(); }
+
+	void push(uint64_t key, GLuint object)
+	{
+		RenderItem item = {key, object};
+		items.push_back(item);
+	}
+
+	// order the items by key; items with equal keys keep the order they were pushed in
+	void sort()
+	{
+		if (items.size() < 2)
+			return;
+		uint64_t differ = 0; // bits that are not the same in every key
+		for (size_t i = 1; i < items.size(); i++)
+			differ |= items[i].key ^ items[0].key;
+		scratch.resize(items.size());
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			if (((differ >> shift) & 0xff) == 0)
+				continue;
+			size_t count[257] = {0};
+			for (size_t i = 0; i < items.size(); i++)
+				count[((items[i].key >> shift) & 0xff) + 1]++;
+			for (int b = 0; b < 256; b++)
+				count[b + 1] += count[b];
+			for (size_t i = 0; i < items.size(); i++)
+				scratch[count[(items[i].key >> shift) & 0xff]++] = items[i];
+			items.swap(scratch);
+		}
+	}
+};
@@ -0,0 +1,157 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- shadercache.h ---
+//
+//  Shader sources read in one go, and linked programs kept on disk
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#if defined(__unix__)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  A program file holds the binary of a linked program as the driver hands
+//  it out with glGetProgramBinary, behind a header. The file is named and
+//  keyed by a hash of everything that goes into the binary: the shader
+//  sources with their defines, the attribute locations, and the vendor,
+//  renderer and version strings of the driver, so that a new driver or an
+//  edited shader never meets an old binary. The driver may still reject a
+//  binary it wrote itself, in which case the program is compiled from its
+//  sources and the file written again.
+//
+//  Program binaries need GL 4.1 or GL_ARB_get_program_binary; without them
+//  every program is compiled.
+//
+
+const uint32_t ProgramCacheFormat = 1;
+
+struct ProgramCacheHeader
+{
+	char magic[8]; // "PROGCACH"
+	uint32_t format;
+	uint32_t binaryFormat; // as glGetProgramBinary gave it
+	uint64_t key;		   // programCacheKey() of the program
+	uint64_t binaryBytes;
+	uint64_t checksum; // of the binary
+};
+
+// the whole file, with one stat and one read; false if it cannot be read
+inline bool readWholeFile(const char *path, std::string &text)
+{
+#if defined(__unix__)
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0;
+	if (ok)
+	{
+		text.resize(st.st_size);
+		size_t done = 0;
+		while (ok && done < text.size())
+		{
+			ssize_t n = ::read(fd, &text[done], text.size() - done);
+			ok = n > 0;
+			done += ok ? n : 0;
+		}
+	}
+	::close(fd);
+	return ok;
+#else
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	text.resize(ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+	bool ok = text.empty() || fread(&text[0], 1, text.size(), fp) == text.size();
+	fclose(fp);
+	return ok;
+#endif
+}
+
+// the key of a program: a hash of its texts (sources, defines, attribute bindings) and of the driver
+inline uint64_t programCacheKey(const std::vector<std::string> &texts)
+{
+	uint64_t h = 14695981039346656037ull;
+	const GLenum strings[3] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+	for (int i = 0; i < 3; i++)
+	{
+		const char *s = (const char *)glGetString(strings[i]);
+		h = meshChecksum(s ? s : "", s ? strlen(s) + 1 : 1, h); // with the NUL, so that texts do not run together
+	}
+	for (size_t i = 0; i < texts.size(); i++)
+		h = meshChecksum(texts[i].c_str(), texts[i].size() + 1, h);
+	return h;
+}
+
+inline bool programBinariesSupported()
+{
+	GLint formats = 0;
+	if (GLEW_ARB_get_program_binary)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// load the binary of the file into the program; true if the file matches the key and the driver accepts it,
+// which leaves the program linked
+inline bool loadProgramBinary(GLuint program, const char *path, uint64_t key)
+{
+	std::string file;
+	if (!readWholeFile(path, file) || file.size() < sizeof(ProgramCacheHeader))
+		return false;
+	ProgramCacheHeader header;
+	memcpy(&header, &file[0], sizeof(header));
+	const char *binary = &file[sizeof(header)];
+	if (memcmp(header.magic, "PROGCACH", 8) != 0 || header.format != ProgramCacheFormat || header.key != key ||
+		sizeof(header) + header.binaryBytes != file.size() ||
+		meshChecksum(binary, header.binaryBytes) != header.checksum)
+		return false;
+	glProgramBinary(program, header.binaryFormat, binary, GLsizei(header.binaryBytes));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+// write the binary of a linked program, created with GL_PROGRAM_BINARY_RETRIEVABLE_HINT, to the file; it is
+// written under a temporary name and renamed, so readers never see half a file
+inline bool saveProgramBinary(GLuint program, const char *path, uint64_t key)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	std::vector<char> binary(length);
+	GLenum binaryFormat;
+	glGetProgramBinary(program, length, &length, &binaryFormat, &binary[0]);
+
+	ProgramCacheHeader header;
+	memcpy(header.magic, "PROGCACH", 8);
+	header.format = ProgramCacheFormat;
+	header.binaryFormat = binaryFormat;
+	header.key = key;
+	header.binaryBytes = uint64_t(length);
+	header.checksum = meshChecksum(&binary[0], header.binaryBytes);
+
+	std::string temporary = std::string(path) + ".tmp";
+	FILE *fp = fopen(temporary.c_str(), "wb");
+	if (!fp)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(&binary[0], 1, header.binaryBytes, fp) == header.binaryBytes;
+	ok = fclose(fp) == 0 && ok;
+	if (ok)
+		ok = rename(temporary.c_str(), path) == 0;
+	if (!ok)
+		remove(temporary.c_str());
+	return ok;
+}
@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- shadervariant.h ---
+//
+//  Compile-time variants of the shaders, picked by the lighting they do
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <stdio.h>
+
+//----------------------------------------------------------------------------
+//
+//  Instead of branching on the light type in every vertex and always paying
+//  for the specular term, the shaders are compiled once per combination of
+//  light type, specular term, number of lights, sphere drawing (meshes,
+//  or ray-cast impostors), tiled point lights and baked lighting, with the
+//  choice written into #defines ahead of their source. Each variant is a program of its
+//  own, numbered by variantKey(), and switching between them is a
+//  glUseProgram.
+//
+
+struct ShaderVariant
+{
+	bool directional; // DIRECTIONAL_LIGHT: the lights are directions instead of points
+	bool specular;	  // SPECULAR: add the specular highlight
+	int lights;		  // NUM_LIGHTS, 1 to MaxLights
+	bool impostor;	  // IMPOSTOR: each sphere is a quad, ray cast per fragment
+	bool tiled;		  // TILED_LIGHTS: add the point lights binned into the tile of the fragment
+	bool baked;		  // BAKED: light the vertices once into a buffer, and draw with the colors from it
+};
+
+const int ShaderVariants = 32 * MaxLights; // every combination
+
+inline int variantKey(const ShaderVariant &v)
+{
+	return (v.lights - 1) << 5 | v.baked << 4 | v.tiled << 3 | v.impostor << 2 | v.specular << 1 | v.directional;
+}
+
+inline ShaderVariant variantOfKey(int key)
+{
+	ShaderVariant v = {(key & 1) != 0, (key & 2) != 0, (key >> 5) + 1, (key & 4) != 0, (key & 8) != 0, (key & 16) != 0};
+	return v;
+}
+
+// the lines defining the variant, to go right after the #version line of both shaders
+inline std::string variantDefines(const ShaderVariant &v)
+{
+	char defines[160];
+	snprintf(defines, sizeof(defines), "%s%s%s%s%s#define NUM_LIGHTS %d\n",
+			 v.directional ? "#define DIRECTIONAL_LIGHT\n" : "", v.specular ? "#define SPECULAR\n" : "",
+			 v.impostor ? "#define IMPOSTOR\n" : "", v.tiled ? "#define TILED_LIGHTS\n" : "",
+			 v.baked ? "#define BAKED\n" : "", v.lights);
+	return defines;
+}
+
+// e.g. "point, specular, 2 lights" or "directional, no specular, 1 light, impostor, tiled"
+inline std::string variantName(const ShaderVariant &v)
+{
+	char name[96];
+	snprintf(name, sizeof(name), "%s, %s, %d light%s%s%s%s", v.directional ? "directional" : "point",
+			 v.specular ? "specular" : "no specular", v.lights, v.lights > 1 ? "s" : "", v.impostor ? ", impostor" : "",
+			 v.tiled ? ", tiled" : "", v.baked ? ", baked" : "");
+	return name;
+}
@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- shaderwatch.h ---
+//
+//  Notices when the shader files are saved, so they can be reloaded
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  On Linux the directory of the files is watched with inotify. Watching
+//  the directory rather than the files catches editors that save by writing
+//  a new file and renaming it over the old one. The descriptor does not
+//  block, so changed() can be polled from a timer and costs one read when
+//  nothing happened. Elsewhere changed() compares the modification times of
+//  the files.
+//
+
+class ShaderWatcher
+{
+	std::vector<std::string> names; // of the files, without the directory
+	std::vector<std::string> paths;
+	std::vector<time_t> modified;
+#if defined(__linux__)
+	int fd;
+#endif
+
+	static time_t modifiedTime(const std::string &path)
+	{
+		struct stat st;
+		return stat(path.c_str(), &st) == 0 ? st.st_mtime : 0;
+	}
+
+public:
+#if defined(__linux__)
+	ShaderWatcher() : fd(-1) {}
+	~ShaderWatcher()
+	{
+		if (fd >= 0)
+			close(fd);
+	}
+#endif
+
+	// start watching the files, which are in one directory; false if they cannot be watched
+	bool watch(const std::vector<std::string> &files)
+	{
+		std::string directory = ".";
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			size_t slash = files[i].rfind('/');
+			if (slash != std::string::npos)
+				directory = files[i].substr(0, slash);
+			names.push_back(slash == std::string::npos ? files[i] : files[i].substr(slash + 1));
+			paths.push_back(files[i]);
+			modified.push_back(modifiedTime(files[i]));
+		}
+#if defined(__linux__)
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0)
+			return false;
+		if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			close(fd);
+			fd = -1;
+			return false;
+		}
+#endif
+		return true;
+	}
+
+	// whether any of the files was saved since the last call
+	bool changed()
+	{
+		bool saved = false;
+#if defined(__linux__)
+		if (fd < 0)
+			return false;
+		alignas(inotify_event) char events[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+		ssize_t bytes;
+		while ((bytes = read(fd, events, sizeof(events))) > 0)
+			for (char *p = events; p < events + bytes;)
+			{
+				const inotify_event *event = (const inotify_event *)p;
+				for (size_t i = 0; event->len && i < names.size(); i++)
+					saved |= names[i] == event->name;
+				p += sizeof(inotify_event) + event->len;
+			}
+#else
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			time_t t = modifiedTime(paths[i]);
+			saved |= t != modified[i];
+			modified[i] = t;
+		}
+#endif
+		return saved;
+	}
+};
@@ -0,0 +1,691 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- sphere.h ---
+//
+//  Sphere generation by recursive subdivision of a tetrahedron
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include "parallel.h"
+#include "arena.h"
+#include "vertexcache.h"
+#include "meshlet.h"
+
+const int MaxTimesToSubdivide = 12; // 4^13 = 67M triangles
+const unsigned SphereGeneratorVersion = 3; // bump whenever the generated vertices or indices change, to invalidate mesh caches
+
+// vertices of the tetrahedron the sphere is subdivided from
+const vec4 TetrahedronVertices[4] = {
+	vec4(0.0, 0.0, 1.0, 1.0),				 // top vertex
+	vec4(0.0, 0.942809, -0.333333, 1.0),		 // bottom vertex
+	vec4(-0.816497, -0.471405, -0.333333, 1.0), // left vertex
+	vec4(0.816497, -0.471405, -0.333333, 1.0)	 // right vertex
+};
+
+// corners of the four faces of the tetrahedron, in the order tetrahedron() divides them
+const int TetrahedronFaces[4][3] = {
+	{0, 1, 2},
+	{3, 2, 1},
+	{0, 3, 1},
+	{0, 2, 3}};
+
+// number of triangles one face is divided into
+inline size_t faceTriangles(int count)
+{
+	return size_t(1) << (2 * count); // 4^count
+}
+
+// number of unique vertices of the sphere: V = F / 2 + 2 for a closed triangle mesh
+inline size_t sphereVertices(int count)
+{
+	return 2 * faceTriangles(count) + 2;
+}
+
+//----------------------------------------------------------------------------
+// normalize the vector and set the w component to 1
+inline vec4 unit(const vec4 &p)
+{
+	float len = p.x * p.x + p.y * p.y + p.z * p.z;
+
+	vec4 t;
+	if (len > 0.0000001)
+	{
+		t = p / sqrt(len);
+		t.w = 1.0;
+	}
+
+	return t;
+}
+
+//----------------------------------------------------------------------------
+//
+//  Triangle soup - every triangle stores its own three corners and flat normal
+//
+//  The generator writes through a SoupSink, a pair of destination arrays
+//  that may be CPU vectors or the inside of a mapped GL buffer, so the
+//  triangles land where they are drawn from without a copy.
+//
+//  The triangles of a subtree are contiguous and every subtree of the same
+//  depth has the same size, so the position of each triangle in the output
+//  is known in closed form. Subtrees are generated on separate threads with
+//  no shared cursor.
+//
+
+// where a triangle soup is written
+struct SoupSink
+{
+	vec4 *points;  // vertices of the triangles
+	vec3 *normals; // normals of the triangles
+};
+
+// number of vertices of the triangle soup
+inline size_t soupVertices(int count)
+{
+	return 4 * 3 * faceTriangles(count);
+}
+
+// a triangle soup kept in CPU memory, drawn from a MeshArena when one is given
+struct TriangleSoup
+{
+	std::vector<vec4, ArenaAllocator<vec4> > points;  // vertices of the triangles
+	std::vector<vec3, ArenaAllocator<vec3> > normals; // normals of the triangles
+
+	TriangleSoup(MeshArena *arena = NULL) : points(ArenaAllocator<vec4>(arena)), normals(ArenaAllocator<vec3>(arena)) {}
+
+	// bytes the arena needs for a soup of n vertices
+	static size_t arenaBytes(size_t n) { return n * (sizeof(vec4) + sizeof(vec3)) + 64; }
+
+	size_t vertexCount() const { return points.size(); }
+	SoupSink sink()
+	{
+		SoupSink out = {&points[0], &normals[0]};
+		return out;
+	}
+};
+
+// store the triangle and its normal at vertex position i
+inline void triangle(const SoupSink &out, size_t i, const vec4 &a, const vec4 &b, const vec4 &c)
+{
+	vec3 normal = normalize(cross(b - a, c - b)); // normal vector of the triangle and for each vertex
+
+	// for each vertex of the triangle store the normal and the vertex in the points and normals array
+	out.normals[i] = normal;
+	out.points[i] = a;
+	out.normals[i + 1] = normal;
+	out.points[i + 1] = b;
+	out.normals[i + 2] = normal;
+	out.points[i + 2] = c;
+}
+
+// divide the triangle into 4 triangles count times and store the result from vertex position i on
+inline void divide_triangle(const SoupSink &out, size_t i, const vec4 &a, const vec4 &b,
+							const vec4 &c, int count)
+{
+	if (count > 0)
+	{
+		size_t child = 3 * faceTriangles(count - 1); // vertices written by each of the 4 sub-triangles
+		vec4 v1 = unit(a + b);						 // calculate the mid point of the edge and normalize it to project it on the sphere
+		vec4 v2 = unit(a + c);
+		vec4 v3 = unit(b + c);
+		divide_triangle(out, i, a, v1, v2, count - 1); // divide the triangle into 4 triangles
+		divide_triangle(out, i + child, c, v2, v3, count - 1);
+		divide_triangle(out, i + 2 * child, b, v3, v1, count - 1);
+		divide_triangle(out, i + 3 * child, v1, v3, v2, count - 1);
+	}
+	else
+	{
+		triangle(out, i, a, b, c);
+	}
+}
+
+// a subtree of the subdivision that one thread generates on its own
+struct SubdivisionTask
+{
+	vec4 a, b, c;
+	int count;	  // subdivisions left
+	size_t first; // vertex position of its first triangle
+};
+
+// expand the subdivision `depth` levels deep without storing triangles, collecting the subtrees below
+inline void splitSubdivision(std::vector<SubdivisionTask> &tasks, size_t i, const vec4 &a, const vec4 &b,
+							 const vec4 &c, int count, int depth)
+{
+	if (depth > 0 && count > 0)
+	{
+		size_t child = 3 * faceTriangles(count - 1);
+		vec4 v1 = unit(a + b);
+		vec4 v2 = unit(a + c);
+		vec4 v3 = unit(b + c);
+		splitSubdivision(tasks, i, a, v1, v2, count - 1, depth - 1);
+		splitSubdivision(tasks, i + child, c, v2, v3, count - 1, depth - 1);
+		splitSubdivision(tasks, i + 2 * child, b, v3, v1, count - 1, depth - 1);
+		splitSubdivision(tasks, i + 3 * child, v1, v3, v2, count - 1, depth - 1);
+	}
+	else
+	{
+		SubdivisionTask t = {a, b, c, count, i};
+		tasks.push_back(t);
+	}
+}
+
+// create a tetrahedron and divide it into a sphere of soupVertices(count) vertices on up to `threads` threads
+inline void tetrahedron(const SoupSink &out, int count, int threads)
+{
+	// about 16 subtrees per thread keeps the threads busy until the end
+	std::vector<SubdivisionTask> tasks;
+	int depth = 0;
+	while (depth < count && (size_t(4) << (2 * depth)) < size_t(16 * threads))
+		depth++;
+	for (int f = 0; f < 4; f++)
+		splitSubdivision(tasks, f * 3 * faceTriangles(count), TetrahedronVertices[TetrahedronFaces[f][0]],
+						 TetrahedronVertices[TetrahedronFaces[f][1]], TetrahedronVertices[TetrahedronFaces[f][2]],
+						 count, depth);
+
+	parallelFor(tasks.size(), threads, [&](size_t t)
+				{ divide_triangle(out, tasks[t].first, tasks[t].a, tasks[t].b, tasks[t].c, tasks[t].count); });
+}
+
+inline void tetrahedron(TriangleSoup &soup, int count, int threads)
+{
+	soup.points.resize(soupVertices(count));
+	soup.normals.resize(soupVertices(count));
+	tetrahedron(soup.sink(), count, threads);
+}
+
+//----------------------------------------------------------------------------
+//
+//  Adaptive subdivision - divide_triangle() driven by screen-space error
+//
+//  An edge is split while the chord between its ends is further than
+//  `tolerance` pixels from the arc it stands for, or while it is longer than
+//  `maxEdge` pixels. The decision depends only on the two ends and the level,
+//  so both triangles of an edge agree on every point along it. A triangle is
+//  divided into 4 when all three of its edges split; otherwise the points its
+//  neighbours put on its edges are stitched with a fan around its centre,
+//  which leaves no T-junctions. Regions facing away from the eye are skipped.
+//
+
+struct SphereView
+{
+	mat4 mvp;			   // projection * model view
+	vec4 eye;			   // eye in object space: a direction (w = 0) for orthographic views, a position (w = 1) otherwise
+	GLfloat width, height; // viewport in pixels
+	GLfloat tolerance;	   // chord error in pixels below which an edge stays whole
+	GLfloat maxEdge;	   // longest projected edge in pixels
+	int maxCount;		   // deepest subdivision
+};
+
+class AdaptiveSphereBuilder
+{
+	const SphereView &view;
+	TriangleSoup &soup;
+	std::vector<vec4> polygon; // boundary of the triangle being stitched
+
+	vec2 project(const vec4 &p) const
+	{
+		vec4 clip = view.mvp * p;
+		return vec2((clip.x / clip.w + 1.0) * 0.5 * view.width, (clip.y / clip.w + 1.0) * 0.5 * view.height);
+	}
+
+	bool split(const vec4 &a, const vec4 &b, int count) const
+	{
+		if (count >= view.maxCount)
+			return false;
+		vec2 pa = project(a), pb = project(b);
+		vec4 chord = (a + b) * 0.5;
+		chord.w = 1.0;
+		return length(project(unit(a + b)) - project(chord)) > view.tolerance || length(pb - pa) > view.maxEdge;
+	}
+
+	// the points the edge ab is split at, from a towards b, excluding a and b
+	void edgePoints(const vec4 &a, const vec4 &b, int count)
+	{
+		if (split(a, b, count))
+		{
+			vec4 m = unit(a + b);
+			edgePoints(a, m, count + 1);
+			polygon.push_back(m);
+			edgePoints(m, b, count + 1);
+		}
+	}
+
+	// true when every normal of the spherical patch abc faces away from the eye
+	bool backFacing(const vec4 &a, const vec4 &b, const vec4 &c) const
+	{
+		vec4 center = unit(a + b + c);
+		vec3 n(center.x, center.y, center.z);
+		GLfloat spread = std::min(std::min(dot(n, vec3(a.x, a.y, a.z)), dot(n, vec3(b.x, b.y, b.z))),
+								  dot(n, vec3(c.x, c.y, c.z))); // cos of the cone around n holding the patch
+		vec3 e(view.eye.x, view.eye.y, view.eye.z);
+		GLfloat distance = length(e);
+		GLfloat cosToEye = dot(n, e) / distance;
+
+		// largest cos between the eye and a normal of the cone; a unit sphere point faces a position eye when n.e > 1
+		GLfloat best = 1.0;
+		if (cosToEye < spread)
+		{
+			GLfloat sinToEye = sqrt(std::max(0.0f, 1.0f - cosToEye * cosToEye));
+			GLfloat sinSpread = sqrt(std::max(0.0f, 1.0f - spread * spread));
+			best = cosToEye * spread + sinToEye * sinSpread; // cos(angle to eye - cone angle)
+		}
+		return view.eye.w == 0.0 ? best < 0.0 : distance * best < 1.0;
+	}
+
+	void emit(const vec4 &a, const vec4 &b, const vec4 &c)
+	{
+		const vec4 *corners[3] = {&a, &b, &c};
+		for (int i = 0; i < 3; i++)
+		{
+			soup.points.push_back(*corners[i]);
+			soup.normals.push_back(vec3(corners[i]->x, corners[i]->y, corners[i]->z));
+		}
+	}
+
+public:
+	AdaptiveSphereBuilder(const SphereView &view, TriangleSoup &soup) : view(view), soup(soup) {}
+
+	// same split as divide_triangle(), stopping where the error is small enough
+	void divide(const vec4 &a, const vec4 &b, const vec4 &c, int count)
+	{
+		if (backFacing(a, b, c))
+			return;
+
+		if (split(a, b, count) && split(b, c, count) && split(c, a, count))
+		{
+			vec4 v1 = unit(a + b);
+			vec4 v2 = unit(a + c);
+			vec4 v3 = unit(b + c);
+			divide(a, v1, v2, count + 1);
+			divide(c, v2, v3, count + 1);
+			divide(b, v3, v1, count + 1);
+			divide(v1, v3, v2, count + 1);
+			return;
+		}
+
+		polygon.clear();
+		polygon.push_back(a);
+		edgePoints(a, b, count);
+		polygon.push_back(b);
+		edgePoints(b, c, count);
+		polygon.push_back(c);
+		edgePoints(c, a, count);
+		if (polygon.size() == 3)
+			emit(a, b, c);
+		else
+		{
+			vec4 center = unit(a + b + c);
+			std::vector<vec4> boundary;
+			boundary.swap(polygon);
+			for (size_t i = 0; i < boundary.size(); i++)
+				emit(center, boundary[i], boundary[(i + 1) % boundary.size()]);
+		}
+	}
+};
+
+// create a tetrahedron and divide it as far as the view needs
+inline void adaptiveTetrahedron(TriangleSoup &soup, const SphereView &view)
+{
+	soup.points.clear();
+	soup.normals.clear();
+	AdaptiveSphereBuilder builder(view, soup);
+	for (int f = 0; f < 4; f++)
+		builder.divide(TetrahedronVertices[TetrahedronFaces[f][0]], TetrahedronVertices[TetrahedronFaces[f][1]],
+					   TetrahedronVertices[TetrahedronFaces[f][2]], 0);
+}
+
+//----------------------------------------------------------------------------
+//
+//  IndexedSphere - shared-vertex sphere mesh drawn with glDrawElements
+//
+//  Every corner is stored once. The levels are refined one at a time and
+//  every edge of the finest level owns the slot of its future midpoint: the
+//  midpoint of edge e becomes vertex V + e of the next level, so the cache
+//  needs no lookups and edges and triangles are split on all cores.
+//
+//  Vertices are only appended, so level k uses the first vertexCount(k)
+//  vertices and a finer level only adds the new midpoints. Going down a
+//  level reuses the coarser index list that was kept.
+//
+//  With optimize set, the triangles of each new level are reordered for the
+//  vertex cache, grouped into meshlets first when clusters is set too, and
+//  its new vertices renumbered in the order they are first drawn. Only the
+//  new vertices move, so the levels still share a prefix. With clusters but
+//  not optimize, the triangles are only grouped into meshlets.
+//
+//  The normal of a vertex on the unit sphere is its position, so the mesh is
+//  smooth shaded instead of the flat shading of the triangle soup.
+//
+
+class IndexedSphere
+{
+	struct Level
+	{
+		std::vector<GLuint> indices; // three indices per triangle
+		size_t vertices;			 // vertices used by this level
+		VertexCacheStats before, after; // of the triangle order before and after optimizing
+		std::vector<Meshlet> meshlets;	// when built with clusters
+
+		Level() : vertices(0)
+		{
+			VertexCacheStats none = {0, 0};
+			before = after = none;
+		}
+	};
+
+	std::vector<Level> levels;	   // every level reserved, built up to finest()
+	int built;					   // finest level built
+	std::vector<GLuint> edges;	   // endpoints of each edge of the finest level, two per edge
+	std::vector<GLuint> triEdges; // edges ab, bc, ca of each triangle abc of the finest level
+
+	GLuint edge(GLuint a, GLuint b)
+	{
+		for (size_t e = 0; e < edges.size(); e += 2)
+			if ((edges[e] == a && edges[e + 1] == b) || (edges[e] == b && edges[e + 1] == a))
+				return GLuint(e / 2);
+		edges.push_back(a);
+		edges.push_back(b);
+		return GLuint(edges.size() / 2 - 1);
+	}
+
+	// the half of edge e that ends at vertex v, after the split
+	GLuint half(GLuint e, GLuint v) const
+	{
+		return edges[2 * e] == v ? 2 * e : 2 * e + 1;
+	}
+
+	// reorder the triangles of a new level for the vertex cache, in meshlets if clusters is set, and renumber its
+	// vertices from V on in the order they are first drawn; the triangle edges and the edge endpoints follow along
+	void optimizeLevel(Level &fine, std::vector<GLuint> &fineEdges, std::vector<GLuint> &fineTriEdges, size_t V)
+	{
+		size_t T = fine.indices.size() / 3;
+		fine.before = vertexCacheStats(&fine.indices[0], fine.indices.size(), fine.vertices);
+		// the meshlets are seeded in cache order, so consecutive meshlets are neighbours too
+		std::vector<GLuint> order = tipsifyOrder(&fine.indices[0], T, fine.vertices);
+		permuteTriangles(order, fine.indices);
+		permuteTriangles(order, fineTriEdges);
+		std::vector<GLuint> sizes;
+		if (clusters)
+			clusterLevel(fine, fineTriEdges, sizes);
+
+		std::vector<GLuint> remap = fetchOrder(&fine.indices[0], fine.indices.size(), fine.vertices, V);
+		for (size_t i = 0; i < fine.indices.size(); i++)
+			fine.indices[i] = remap[fine.indices[i]];
+		for (size_t i = 0; i < fineEdges.size(); i++)
+			fineEdges[i] = remap[fineEdges[i]];
+		remapVertices(remap, points, V);
+		remapVertices(remap, normals, V);
+		fine.after = vertexCacheStats(&fine.indices[0], fine.indices.size(), fine.vertices);
+		boundMeshlets(fine, sizes);
+	}
+
+	// reorder the triangles of a new level meshlet by meshlet, with their edges, and give the triangle counts
+	// of the meshlets in sizes
+	void clusterLevel(Level &fine, std::vector<GLuint> &fineTriEdges, std::vector<GLuint> &sizes)
+	{
+		std::vector<GLuint> order = meshletOrder(&fine.indices[0], fine.indices.size() / 3, fine.vertices, sizes);
+		permuteTriangles(order, fine.indices);
+		permuteTriangles(order, fineTriEdges);
+	}
+
+	// the meshlets of a new level, once its vertices are where they stay
+	void boundMeshlets(Level &fine, const std::vector<GLuint> &sizes)
+	{
+		GLuint first = 0;
+		for (size_t m = 0; m < sizes.size(); first += sizes[m++])
+			fine.meshlets.push_back(meshletBounds(&fine.indices[0], &points[0], first, sizes[m]));
+	}
+
+	// split every edge and triangle of the finest level, in the same order as divide_triangle() unless optimized
+	// or clustered; the level and its vertices have to be reserved
+	void refine(int threads)
+	{
+		const Level &coarse = levels[built];
+		size_t V = coarse.vertices, E = edges.size() / 2, T = coarse.indices.size() / 3;
+
+		Level &fine = levels[built + 1];
+		fine.vertices = V + E;
+		fine.indices.resize(3 * 4 * T);
+		std::vector<GLuint> fineEdges(2 * (2 * E + 3 * T));
+		std::vector<GLuint> fineTriEdges(3 * 4 * T);
+
+		// the midpoint of each edge and its two halves
+		parallelForChunks(E, 4096, threads, [&](size_t e)
+						  {
+			GLuint m = GLuint(V + e);
+			vec4 p = unit(points[edges[2 * e]] + points[edges[2 * e + 1]]);
+			points[m] = p;
+			normals[m] = vec3(p.x, p.y, p.z);
+			fineEdges[4 * e] = edges[2 * e];
+			fineEdges[4 * e + 1] = m;
+			fineEdges[4 * e + 2] = m;
+			fineEdges[4 * e + 3] = edges[2 * e + 1]; });
+
+		// four triangles and three inner edges per triangle
+		parallelForChunks(T, 4096, threads, [&](size_t t)
+						  {
+			const GLuint *tri = &coarse.indices[3 * t];
+			GLuint a = tri[0], b = tri[1], c = tri[2];
+			GLuint eab = triEdges[3 * t], ebc = triEdges[3 * t + 1], eca = triEdges[3 * t + 2];
+			GLuint v1 = GLuint(V + eab), v2 = GLuint(V + eca), v3 = GLuint(V + ebc);
+			GLuint i0 = GLuint(2 * E + 3 * t), i1 = i0 + 1, i2 = i0 + 2; // v1v2, v2v3, v3v1
+
+			GLuint *inner = &fineEdges[2 * i0];
+			inner[0] = v1, inner[1] = v2;
+			inner[2] = v2, inner[3] = v3;
+			inner[4] = v3, inner[5] = v1;
+
+			GLuint children[4][3] = {{a, v1, v2}, {c, v2, v3}, {b, v3, v1}, {v1, v3, v2}};
+			GLuint childEdges[4][3] = {{half(eab, a), i0, half(eca, a)},
+									   {half(eca, c), i1, half(ebc, c)},
+									   {half(ebc, b), i2, half(eab, b)},
+									   {i2, i1, i0}};
+			for (int k = 0; k < 4; k++)
+				for (int j = 0; j < 3; j++)
+				{
+					fine.indices[3 * (4 * t + k) + j] = children[k][j];
+					fineTriEdges[3 * (4 * t + k) + j] = childEdges[k][j];
+				} });
+
+		if (optimize)
+			optimizeLevel(fine, fineEdges, fineTriEdges, V);
+		else if (clusters) // meshlets in subdivision order, without the vertex cache order
+		{
+			std::vector<GLuint> sizes;
+			clusterLevel(fine, fineTriEdges, sizes);
+			boundMeshlets(fine, sizes);
+		}
+		edges.swap(fineEdges);
+		triEdges.swap(fineTriEdges);
+		built++;
+	}
+
+public:
+	std::vector<vec4> points;  // vertices of every level reserved; those of finest() and coarser are built
+	std::vector<vec3> normals; // normal of each vertex
+	bool optimize;			   // reorder each new level for the vertex cache
+	bool clusters;			   // and group it into meshlets, at some cost in vertex cache hits if optimized
+
+	// level 0 is the tetrahedron itself
+	IndexedSphere() : built(0), optimize(true), clusters(false)
+	{
+		Level tetra;
+		for (int i = 0; i < 4; i++)
+		{
+			points.push_back(TetrahedronVertices[i]);
+			normals.push_back(vec3(TetrahedronVertices[i].x, TetrahedronVertices[i].y, TetrahedronVertices[i].z));
+		}
+		for (int f = 0; f < 4; f++)
+		{
+			GLuint a = TetrahedronFaces[f][0], b = TetrahedronFaces[f][1], c = TetrahedronFaces[f][2];
+			tetra.indices.push_back(a);
+			tetra.indices.push_back(b);
+			tetra.indices.push_back(c);
+			triEdges.push_back(edge(a, b));
+			triEdges.push_back(edge(b, c));
+			triEdges.push_back(edge(c, a));
+		}
+		tetra.vertices = 4;
+		levels.push_back(tetra);
+	}
+
+	// size the arrays for every level up to count, so that building the levels only fills them in: no array
+	// changes its size or moves while they are built. Not while another thread reads the sphere
+	void reserve(int count)
+	{
+		if (int(levels.size()) > count)
+			return;
+		levels.resize(count + 1);
+		points.resize(sphereVertices(count));
+		normals.resize(sphereVertices(count));
+	}
+
+	// finest level built so far
+	int finest() const { return built; }
+
+	// build the levels up to count, computing only the midpoints that are new; returns the number of new vertices
+	size_t subdivide(int count, int threads)
+	{
+		reserve(count);
+		size_t before = vertexCount(built);
+		while (built < count)
+			refine(threads);
+		return vertexCount(built) - before;
+	}
+
+	// the level must have been built with subdivide()
+	const std::vector<GLuint> &indices(int count) const { return levels[count].indices; }
+	size_t vertexCount(int count) const { return levels[count].vertices; }
+	// vertex cache behaviour of the level before and after optimizing; zero if it was not optimized
+	const VertexCacheStats &cacheBefore(int count) const { return levels[count].before; }
+	const VertexCacheStats &cacheAfter(int count) const { return levels[count].after; }
+	// meshlets of the level, in index order; empty unless it was built with clusters
+	const std::vector<Meshlet> &meshlets(int count) const { return levels[count].meshlets; }
+
+	// smallest index type that can address every vertex of the level
+	GLenum indexType(int count) const
+	{
+		return vertexCount(count) <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
+
+	GLsizeiptr indexBytes(int count) const
+	{
+		return indices(count).size() * (indexType(count) == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+	}
+
+	// number of indices of levels 0..count together
+	size_t lodIndexCount(int count) const
+	{
+		size_t total = 0;
+		for (int k = 0; k <= count; k++)
+			total += levels[k].indices.size();
+		return total;
+	}
+
+	// write the index lists of levels 0..count back to back into lodIndexCount(count) indices;
+	// first[k] is where level k starts
+	template <class Index>
+	void lodIndices(int count, Index *out, size_t *first) const
+	{
+		size_t at = 0;
+		for (int k = 0; k <= count; k++)
+		{
+			first[k] = at;
+			std::copy(levels[k].indices.begin(), levels[k].indices.end(), out + at);
+			at += levels[k].indices.size();
+		}
+	}
+};
+
+//----------------------------------------------------------------------------
+//
+//  Level of detail selection from the projected size of the sphere
+//
+//  The longest edge of level k spans the tetrahedron edge angle / 2^k, and
+//  the chord of an arc of angle t lies r (1 - cos(t / 2)) inside the sphere.
+//
+
+const GLfloat TetrahedronEdgeAngle = 1.910633; // acos(-1/3)
+
+// largest distance in pixels between the level and the true sphere of the given projected radius
+inline GLfloat sphereChordError(int count, GLfloat radiusPixels)
+{
+	GLfloat angle = TetrahedronEdgeAngle / GLfloat(1 << count);
+	return radiusPixels * (1.0 - cos(angle / 2.0));
+}
+
+// coarsest level no further than tolerance pixels from the sphere
+inline int sphereLevelFor(GLfloat radiusPixels, GLfloat tolerance, int finest)
+{
+	int count = 0;
+	while (count < finest && sphereChordError(count, radiusPixels) > tolerance)
+		count++;
+	return count;
+}
+
+// level to draw after `current`: refine as soon as the error exceeds the tolerance, but only coarsen
+// once the coarser level is within half of it, so a radius near a threshold does not flicker
+inline int selectSphereLevel(GLfloat radiusPixels, GLfloat tolerance, int current, int finest)
+{
+	int finer = sphereLevelFor(radiusPixels, tolerance, finest);
+	int coarser = sphereLevelFor(radiusPixels, 0.5 * tolerance, finest);
+	if (current < 0 || finer > current)
+		return finer;
+	if (coarser < current)
+		return coarser;
+	return std::min(current, finest);
+}
+
+//----------------------------------------------------------------------------
+//
+//  SphereRefiner - builds finer levels of an IndexedSphere on a worker thread
+//
+//  The sphere is reserved up to the target level first, so the worker only
+//  fills in levels and vertices past the ones built, and no array changes
+//  its size or moves. Each finished level is published by a release store
+//  of readyLevel(): a thread that has read it may read every level up to
+//  it, with its vertices, while the worker runs.
+//
+
+class SphereRefiner
+{
+	std::thread worker;
+	std::atomic<int> ready;	  // finest level that is complete
+	std::atomic<bool> busy;	  // worker still refining
+	std::atomic<bool> cancel; // stop after the current level
+
+public:
+	SphereRefiner() : ready(0), busy(false), cancel(false) {}
+	~SphereRefiner()
+	{
+		cancel = true;
+		finish();
+	}
+
+	// refine the sphere up to count in the background
+	void start(IndexedSphere &sphere, int count, int threads)
+	{
+		finish();
+		sphere.reserve(count);
+		ready = sphere.finest();
+		busy = true;
+		worker = std::thread([this, &sphere, count, threads]()
+							 {
+			while (!cancel && sphere.finest() < count)
+			{
+				sphere.subdivide(sphere.finest() + 1, threads);
+				ready.store(sphere.finest(), std::memory_order_release);
+			}
+			busy = false; });
+	}
+
+	// wait for the worker to stop
+	void finish()
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+
+	bool running() const { return busy; }
+	int readyLevel() const { return ready.load(std::memory_order_acquire); }
+};
@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- startup.h ---
+//
+//  Startup stages run on threads of their own, waited for by the stages that need them
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <thread>
+
+//----------------------------------------------------------------------------
+//
+//  Startup is a small dependency graph: each stage that needs no GL
+//  context (loading or subdividing the sphere, scattering the instances)
+//  runs on a thread of its own from the start of main, while the main
+//  thread creates the context and builds the shaders. A stage that needs
+//  the result of another one (an upload) waits for it first. A stage that
+//  was never started counts as done.
+//
+
+class StartupTask
+{
+	std::thread thread;
+
+public:
+	~StartupTask() { wait(); }
+
+	template <class F>
+	void start(F f)
+	{
+		wait();
+		thread = std::thread(f);
+	}
+
+	// block until the stage is done
+	void wait()
+	{
+		if (thread.joinable())
+			thread.join();
+	}
+};
@@ -0,0 +1,221 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- tiledlights.h ---
+//
+//  Point lights with a falloff radius, binned into screen tiles for the fragment shader
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <math.h>
+
+//----------------------------------------------------------------------------
+//
+//  Tiled forward lighting: every frame whose view changed, the CPU moves
+//  the lights into eye coordinates, where the shaders light the fragments,
+//  bounds each light's sphere of influence on the screen and appends it to
+//  the list of every LightTile x LightTile pixel tile the bounds touch. The
+//  lists are packed back to back, and the fragment shader finds its tile
+//  from gl_FragCoord and loops over that tile's lights only, so its cost
+//  follows the number of lights near the fragment rather than their total.
+//
+//  The shaders are GLSL 1.30, which has neither storage buffers nor buffer
+//  textures, so the lists travel in 2D textures read with texelFetch:
+//
+//      lights   RGBA32F  two texels per light: eye position and radius, color
+//      tiles    RG32UI   one texel per tile: first entry and count
+//      entries  R32UI    light numbers of every tile, back to back
+//
+//  The lights and the entries are laid out LightTextureWidth texels to a
+//  row, so that long lists stay within the texture size limits.
+//
+
+const int LightTile = 16;			   // pixels on a side of a screen tile
+const int LightTextureWidth = 1024;	   // texels in a row of the light and entry textures
+const GLuint TiledLightsFirstUnit = 1; // texture units of the lights, the tiles and the entries, in that order
+
+struct PointLight
+{
+	vec4 positionRadius; // in object coordinates; the light fades out at the radius
+	vec4 color;			 // diffuse and specular color
+};
+
+// lights spread uniformly over the box, with radii from radiusLow to radiusHigh and saturated colors
+inline std::vector<PointLight> scatterLights(size_t count, const vec3 &low, const vec3 &high, GLfloat radiusLow,
+											 GLfloat radiusHigh, uint32_t seed = 7)
+{
+	uint32_t state = seed;
+	auto random = [&state]() // xorshift32, 0 to 1
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return GLfloat(state >> 8) / GLfloat(1 << 24);
+	};
+	std::vector<PointLight> lights(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		vec3 p(low.x + random() * (high.x - low.x), low.y + random() * (high.y - low.y),
+			   low.z + random() * (high.z - low.z));
+		lights[i].positionRadius = vec4(p.x, p.y, p.z, radiusLow + random() * (radiusHigh - radiusLow));
+		GLfloat hue = random() * 6;
+		int sector = int(hue);
+		GLfloat f = hue - sector;
+		const GLfloat rgb[6][3] = {{1, f, 0}, {1 - f, 1, 0}, {0, 1, f}, {0, 1 - f, 1}, {f, 0, 1}, {1, 0, 1 - f}};
+		lights[i].color = vec4(rgb[sector % 6][0], rgb[sector % 6][1], rgb[sector % 6][2], 1.0);
+	}
+	return lights;
+}
+
+// the pixels the light's sphere, in eye coordinates, may reach on a width x height viewport: x0 <= x < x1,
+// y0 <= y < y1; false if none. The corners of the box around the sphere are projected, which holds under any
+// projection; a corner behind the eye makes the whole viewport count
+inline bool lightRect(const mat4 &projection, const vec4 &light, int width, int height, int &x0, int &y0, int &x1, int &y1)
+{
+	GLfloat low[2] = {1e30f, 1e30f}, high[2] = {-1e30f, -1e30f};
+	for (int c = 0; c < 8; c++)
+	{
+		vec4 corner(light.x + (c & 1 ? light.w : -light.w), light.y + (c & 2 ? light.w : -light.w),
+					light.z + (c & 4 ? light.w : -light.w), 1.0);
+		vec4 clip = projection * corner;
+		if (clip.w <= 0)
+		{
+			x0 = y0 = 0;
+			x1 = width;
+			y1 = height;
+			return true;
+		}
+		for (int a = 0; a < 2; a++)
+		{
+			low[a] = std::min(low[a], clip[a] / clip.w);
+			high[a] = std::max(high[a], clip[a] / clip.w);
+		}
+	}
+	x0 = std::max(0, int(floor((low[0] * 0.5f + 0.5f) * width)));
+	y0 = std::max(0, int(floor((low[1] * 0.5f + 0.5f) * height)));
+	x1 = std::min(width, int(ceil((high[0] * 0.5f + 0.5f) * width)));
+	y1 = std::min(height, int(ceil((high[1] * 0.5f + 0.5f) * height)));
+	return x0 < x1 && y0 < y1;
+}
+
+class LightGrid
+{
+	GLuint textures[3]; // lights, tiles, entries
+	std::vector<vec4> texels;	// of the lights
+	std::vector<GLuint> ranges; // first entry and count of every tile
+	std::vector<GLuint> entries;
+	std::vector<int> rects; // x0, y0, x1, y1 in tiles of every light, all 0 when it is off screen
+
+	static void setUp(GLuint texture)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // integer textures cannot be filtered
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	// texels laid out LightTextureWidth to a row; the last row is padded, which the vector has to allow for
+	static void upload(GLuint texture, GLenum internalFormat, GLenum format, GLenum type, const void *texels,
+					   size_t count)
+	{
+		int rows = int(std::max<size_t>(1, (count + LightTextureWidth - 1) / LightTextureWidth));
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, LightTextureWidth, rows, 0, format, type, texels);
+	}
+
+public:
+	int tilesX, tilesY;
+	size_t maxPerTile; // most lights in one tile, after the last bin()
+
+	LightGrid() : tilesX(0), tilesY(0), maxPerTile(0) { textures[0] = textures[1] = textures[2] = 0; }
+
+	void create()
+	{
+		glGenTextures(3, textures);
+		for (int t = 0; t < 3; t++)
+			setUp(textures[t]);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// move the lights into eye coordinates, bin them into the tiles of a width x height viewport and upload
+	// them with the lists; returns the number of entries. modelView may scale, but only uniformly
+	size_t bin(const std::vector<PointLight> &lights, const mat4 &modelView, const mat4 &projection, int width,
+			   int height)
+	{
+		GLfloat scale = length(vec3(modelView[0].x, modelView[0].y, modelView[0].z));
+		texels.assign(std::max<size_t>(1, (2 * lights.size() + LightTextureWidth - 1) / LightTextureWidth) *
+						  LightTextureWidth,
+					  vec4(0.0, 0.0, 0.0, 0.0));
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			const vec4 &p = lights[i].positionRadius;
+			texels[2 * i] = modelView * vec4(p.x, p.y, p.z, 1.0);
+			texels[2 * i].w = p.w * scale;
+			texels[2 * i + 1] = lights[i].color;
+		}
+
+		tilesX = (width + LightTile - 1) / LightTile;
+		tilesY = (height + LightTile - 1) / LightTile;
+		ranges.assign(2 * tilesX * tilesY, 0);
+		rects.resize(4 * lights.size());
+
+		// count the lights of every tile, then turn the counts into first entries, then fill in the lists
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			int *r = &rects[4 * i];
+			if (!lightRect(projection, texels[2 * i], width, height, r[0], r[1], r[2], r[3]))
+			{
+				r[0] = r[1] = r[2] = r[3] = 0;
+				continue;
+			}
+			r[0] /= LightTile;
+			r[1] /= LightTile;
+			r[2] = (r[2] + LightTile - 1) / LightTile;
+			r[3] = (r[3] + LightTile - 1) / LightTile;
+			for (int y = r[1]; y < r[3]; y++)
+				for (int x = r[0]; x < r[2]; x++)
+					ranges[2 * (y * tilesX + x) + 1]++;
+		}
+		GLuint total = 0;
+		maxPerTile = 0;
+		for (int t = 0; t < tilesX * tilesY; t++)
+		{
+			ranges[2 * t] = total;
+			total += ranges[2 * t + 1];
+			maxPerTile = std::max<size_t>(maxPerTile, ranges[2 * t + 1]);
+			ranges[2 * t + 1] = 0;
+		}
+		entries.assign(std::max<size_t>(1, (total + LightTextureWidth - 1) / LightTextureWidth) * LightTextureWidth, 0);
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			const int *r = &rects[4 * i];
+			for (int y = r[1]; y < r[3]; y++)
+				for (int x = r[0]; x < r[2]; x++)
+				{
+					GLuint *range = &ranges[2 * (y * tilesX + x)];
+					entries[range[0] + range[1]++] = GLuint(i);
+				}
+		}
+
+		upload(textures[0], GL_RGBA32F, GL_RGBA, GL_FLOAT, &texels[0], texels.size());
+		glBindTexture(GL_TEXTURE_2D, textures[1]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, tilesX, tilesY, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, &ranges[0]);
+		upload(textures[2], GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &entries[0], entries.size());
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return total;
+	}
+
+	// bind the textures to their units, TiledLightsFirstUnit on
+	void bind()
+	{
+		for (int t = 0; t < 3; t++)
+		{
+			glActiveTexture(GL_TEXTURE0 + TiledLightsFirstUnit + t);
+			glBindTexture(GL_TEXTURE_2D, textures[t]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+};
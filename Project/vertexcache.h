@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- vertexcache.h ---
+//
+//  Triangle and vertex reordering for the post-transform vertex cache
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+//
+//  The GPU keeps the last few transformed vertices, so an index that was
+//  seen recently is not shaded again. Tipsify (Sander, Nehab, Barczak 2007)
+//  orders the triangles in fans around vertices, moving on to a neighbour
+//  that is still in the cache, which brings the average cache miss ratio
+//  (ACMR, shaded vertices per triangle) of a closed mesh close to its
+//  optimum of 0.5. Renumbering the vertices in the order they are first
+//  used then makes the vertex fetches walk the buffer front to back.
+//
+//  Both work on any triangle list; the indexed sphere runs them on each
+//  level as it is refined.
+//
+
+const int VertexCacheSize = 16; // FIFO entries assumed by the optimizer and the statistics
+
+struct VertexCacheStats
+{
+	double acmr; // shaded vertices per triangle, 0.5 to 3
+	double atvr; // shaded vertices per referenced vertex, 1 at best
+};
+
+// simulate a FIFO cache of `cacheSize` vertices over the triangle list
+inline VertexCacheStats vertexCacheStats(const GLuint *indices, size_t count, size_t vertices,
+										 int cacheSize = VertexCacheSize)
+{
+	std::vector<size_t> entered(vertices, size_t(-1)); // miss count when the vertex entered the cache
+	size_t misses = 0, used = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		GLuint v = indices[i];
+		if (entered[v] == size_t(-1))
+			used++;
+		else if (misses - entered[v] < size_t(cacheSize))
+			continue;
+		entered[v] = misses++;
+	}
+	VertexCacheStats stats = {count ? double(misses) / (count / 3) : 0, used ? double(misses) / used : 0};
+	return stats;
+}
+
+// the triangles around each vertex v: around[first[v]] to around[first[v + 1] - 1]
+inline void trianglesAround(const GLuint *indices, size_t triangles, size_t vertices, std::vector<size_t> &first,
+							std::vector<GLuint> &around)
+{
+	first.assign(vertices + 1, 0);
+	for (size_t i = 0; i < 3 * triangles; i++)
+		first[indices[i] + 1]++;
+	for (size_t v = 0; v < vertices; v++)
+		first[v + 1] += first[v];
+	around.resize(3 * triangles);
+	std::vector<size_t> fill(first.begin(), first.end() - 1);
+	for (size_t i = 0; i < 3 * triangles; i++)
+		around[fill[indices[i]]++] = GLuint(i / 3);
+}
+
+// the order in which to draw the triangles for a cache of `cacheSize` vertices
+inline std::vector<GLuint> tipsifyOrder(const GLuint *indices, size_t triangles, size_t vertices,
+										int cacheSize = VertexCacheSize)
+{
+	std::vector<size_t> first;
+	std::vector<GLuint> around;
+	trianglesAround(indices, triangles, vertices, first, around);
+
+	std::vector<int> live(vertices); // triangles around the vertex not drawn yet
+	for (size_t v = 0; v < vertices; v++)
+		live[v] = int(first[v + 1] - first[v]);
+	std::vector<size_t> stamp(vertices, 0); // time the vertex entered the cache
+	std::vector<char> drawn(triangles, 0);
+	std::vector<GLuint> order, deadEnd, candidates;
+	order.reserve(triangles);
+	size_t time = cacheSize + 1, cursor = 0;
+
+	while (cursor < vertices && live[cursor] == 0)
+		cursor++;
+	long fan = cursor < vertices ? long(cursor) : -1;
+	while (fan >= 0)
+	{
+		// draw every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (size_t j = first[fan]; j < first[fan + 1]; j++)
+		{
+			GLuint t = around[j];
+			if (drawn[t])
+				continue;
+			drawn[t] = 1;
+			order.push_back(t);
+			for (int c = 0; c < 3; c++)
+			{
+				GLuint v = indices[3 * t + c];
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamp[v] > size_t(cacheSize))
+					stamp[v] = time++;
+			}
+		}
+
+		// continue from the candidate that will still be cached once its own fan is drawn, the oldest first
+		fan = -1;
+		long best = -1;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			GLuint v = candidates[i];
+			if (live[v] <= 0)
+				continue;
+			long priority = 0;
+			if (time - stamp[v] + 2 * live[v] <= size_t(cacheSize))
+				priority = long(time - stamp[v]);
+			if (priority > best)
+				best = priority, fan = v;
+		}
+		// at a dead end, go back to a recent vertex with triangles left, or else the next one in order
+		while (fan < 0 && !deadEnd.empty())
+		{
+			GLuint v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0)
+				fan = v;
+		}
+		while (fan < 0 && cursor < vertices)
+			if (live[cursor] > 0)
+				fan = long(cursor);
+			else
+				cursor++;
+	}
+	return order;
+}
+
+// new number of every vertex from `from` on, in the order the triangle list first uses them; vertices below
+// `from` keep their numbers and unused ones go last
+inline std::vector<GLuint> fetchOrder(const GLuint *indices, size_t count, size_t vertices, size_t from = 0)
+{
+	std::vector<GLuint> remap(vertices, GLuint(-1));
+	for (size_t v = 0; v < from; v++)
+		remap[v] = GLuint(v);
+	GLuint next = GLuint(from);
+	for (size_t i = 0; i < count; i++)
+		if (remap[indices[i]] == GLuint(-1))
+			remap[indices[i]] = next++;
+	for (size_t v = from; v < vertices; v++)
+		if (remap[v] == GLuint(-1))
+			remap[v] = next++;
+	return remap;
+}
+
+// put the three values per triangle of a list in the given triangle order
+inline void permuteTriangles(const std::vector<GLuint> &order, std::vector<GLuint> &values)
+{
+	std::vector<GLuint> sorted(values.size());
+	for (size_t t = 0; t < order.size(); t++)
+		std::copy(&values[3 * order[t]], &values[3 * order[t]] + 3, &sorted[3 * t]);
+	values.swap(sorted);
+}
+
+// reorder the triangles of an index list for the vertex cache
+inline void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertices)
+{
+	permuteTriangles(tipsifyOrder(&indices[0], indices.size() / 3, vertices), indices);
+}
+
+// move the attribute of every vertex that remap numbers, from `from` on, to its new number; the attribute
+// array may be longer
+template <class Attribute>
+inline void remapVertices(const std::vector<GLuint> &remap, std::vector<Attribute> &attribute, size_t from = 0)
+{
+	std::vector<Attribute> moved(attribute.begin() + from, attribute.begin() + remap.size());
+	for (size_t v = from; v < remap.size(); v++)
+		attribute[remap[v]] = moved[v - from];
+}
+
+// renumber the vertices of an index list in the order it uses them, moving their attributes along
+inline void optimizeVertexFetch(std::vector<GLuint> &indices, std::vector<vec4> &points, std::vector<vec3> &normals)
+{
+	std::vector<GLuint> remap = fetchOrder(&indices[0], indices.size(), points.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = remap[indices[i]];
+	remapVertices(remap, points);
+	remapVertices(remap, normals);
+}
@@ -0,0 +1,308 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- vertexformat.h ---
+//
+//  Packed vertex formats and layouts for the indexed sphere
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+//
+//  A vertex is stored as a position and a normal. The float format keeps the
+//  28 bytes of vec4 + vec3; the packed formats store the position as three
+//  16-bit values (w is implied, since glVertexAttribPointer fills in w = 1)
+//  and the normal as two 16-bit snorms in octahedral encoding, 12 bytes in
+//  all. Snorm positions cover [-1, 1], which holds the unit sphere.
+//
+
+enum VertexFormat
+{
+	FloatVertices,	 // vec4 position, vec3 normal
+	HalfVertices,	 // half float position, octahedral snorm16 normal
+	Snorm16Vertices, // snorm16 position, octahedral snorm16 normal
+	VertexFormats
+};
+
+struct VertexFormatInfo
+{
+	const char *name;
+	GLsizei positionBytes, normalBytes; // per vertex
+	GLint positionSize;
+	GLenum positionType;
+	GLboolean positionNormalized;
+	GLint normalSize;
+	GLenum normalType;
+	GLboolean normalNormalized;
+	bool octahedral; // the normal is two octahedral coordinates, decoded in the vertex shader
+};
+
+const VertexFormatInfo VertexFormatInfos[VertexFormats] = {
+	{"float", sizeof(vec4), sizeof(vec3), 4, GL_FLOAT, GL_FALSE, 3, GL_FLOAT, GL_FALSE, false},
+	{"half", 4 * sizeof(GLushort), 2 * sizeof(GLshort), 3, GL_HALF_FLOAT, GL_FALSE, 2, GL_SHORT, GL_TRUE, true},
+	{"snorm16", 4 * sizeof(GLshort), 2 * sizeof(GLshort), 3, GL_SHORT, GL_TRUE, 2, GL_SHORT, GL_TRUE, true}};
+
+// bytes of `count` vertices
+inline size_t vertexBytes(VertexFormat format, size_t count)
+{
+	return count * (VertexFormatInfos[format].positionBytes + VertexFormatInfos[format].normalBytes);
+}
+
+// --- scalar encodings ---
+
+inline GLshort snorm16(GLfloat x)
+{
+	return GLshort(floor(std::max(-1.0f, std::min(1.0f, x)) * 32767.0f + 0.5f));
+}
+
+inline GLfloat fromSnorm16(GLshort s)
+{
+	return std::max(-1.0f, s / 32767.0f);
+}
+
+// IEEE half float, rounded to nearest even
+inline GLushort halfFloat(GLfloat x)
+{
+	uint32_t f;
+	memcpy(&f, &x, 4);
+	uint32_t sign = (f >> 16) & 0x8000;
+	f &= 0x7fffffff;
+	if (f >= 0x47800000) // too large for a half, or inf/nan
+		return GLushort(sign | (f > 0x7f800000 ? 0x7e00 : 0x7c00));
+	if (f < 0x38800000) // subnormal half
+	{
+		GLfloat a;
+		memcpy(&a, &f, 4);
+		return GLushort(sign | GLushort(floor(a * 16777216.0f + 0.5f))); // a / 2^-24
+	}
+	uint32_t h = ((f - 0x38000000) >> 13);		   // rebias the exponent, drop 13 mantissa bits
+	uint32_t rest = f & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) // round to nearest even
+		h++;
+	return GLushort(sign | h);
+}
+
+inline GLfloat fromHalfFloat(GLushort h)
+{
+	GLfloat m = ldexp(GLfloat(h & 0x3ff), -24);
+	int e = (h >> 10) & 0x1f;
+	GLfloat v = e == 0 ? m : e == 31 ? INFINITY : ldexp(1.0f + (h & 0x3ff) / 1024.0f, e - 15);
+	return h & 0x8000 ? -v : v;
+}
+
+// --- octahedral normals ---
+
+inline vec2 octEncode(const vec3 &n)
+{
+	GLfloat s = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	vec2 p(n.x / s, n.y / s);
+	if (n.z < 0) // fold the lower half over the diagonals
+		p = vec2((1 - fabs(p.y)) * (p.x >= 0 ? 1 : -1), (1 - fabs(p.x)) * (p.y >= 0 ? 1 : -1));
+	return p;
+}
+
+// the same decode as vshader.glsl
+inline vec3 octDecode(const vec2 &p)
+{
+	vec3 n(p.x, p.y, 1 - fabs(p.x) - fabs(p.y));
+	if (n.z < 0)
+		n = vec3((1 - fabs(p.y)) * (p.x >= 0 ? 1 : -1), (1 - fabs(p.x)) * (p.y >= 0 ? 1 : -1), n.z);
+	GLfloat l = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+	return vec3(n.x / l, n.y / l, n.z / l);
+}
+
+// angle between two normals in radians, accurate for tiny angles too
+inline double normalAngle(const vec3 &a, const vec3 &b)
+{
+	double cx = double(a.y) * b.z - double(a.z) * b.y, cy = double(a.z) * b.x - double(a.x) * b.z,
+		   cz = double(a.x) * b.y - double(a.y) * b.x;
+	return atan2(sqrt(cx * cx + cy * cy + cz * cz), double(a.x) * b.x + double(a.y) * b.y + double(a.z) * b.z);
+}
+
+// octahedral snorm16 normal; of the four roundings of the coordinates, keeps the one closest in angle
+inline void octSnorm16(const vec3 &n, GLshort out[2])
+{
+	vec2 p = octEncode(n) * 32767.0f;
+	double best = 4;
+	for (int i = 0; i < 4; i++)
+	{
+		GLshort c[2] = {GLshort(std::max(-32767.0f, std::min(32767.0f, i & 1 ? ceil(p.x) : floor(p.x)))),
+						GLshort(std::max(-32767.0f, std::min(32767.0f, i & 2 ? ceil(p.y) : floor(p.y))))};
+		double d = normalAngle(n, octDecode(vec2(fromSnorm16(c[0]), fromSnorm16(c[1]))));
+		if (d < best)
+		{
+			best = d;
+			out[0] = c[0], out[1] = c[1];
+		}
+	}
+}
+
+// --- layouts ---
+
+//----------------------------------------------------------------------------
+//
+//  A layout places the encoded attributes of `count` vertices in one block
+//  of packed vertex data, which is uploaded into one or two buffer objects:
+//
+//    split        one buffer, all positions then all normals
+//    interleaved  one buffer, position and normal of each vertex together
+//    streams      each attribute in a buffer of its own
+//
+//  The same generator output is written into any of them, and the
+//  attribute pointers are derived from the layout.
+//
+
+enum VertexLayoutKind
+{
+	SplitLayout,
+	InterleavedLayout,
+	StreamLayout,
+	VertexLayouts
+};
+
+const char *const VertexLayoutNames[VertexLayouts] = {"split", "interleaved", "streams"};
+
+struct VertexAttrib
+{
+	int buffer;		 // which buffer of the layout holds it
+	size_t offset;	 // of the first vertex, in that buffer
+	GLsizei stride;
+};
+
+struct VertexLayout
+{
+	VertexFormat format;
+	VertexLayoutKind kind;
+	size_t count;
+	int buffers;
+	size_t bufferOffset[2], bufferBytes[2]; // where each buffer lies in the packed vertex data
+	VertexAttrib position, normal;
+
+	size_t bytes() const { return bufferOffset[buffers - 1] + bufferBytes[buffers - 1]; }
+	// offset of an attribute of vertex i in the packed vertex data
+	size_t at(const VertexAttrib &a, size_t i) const { return bufferOffset[a.buffer] + a.offset + i * a.stride; }
+};
+
+inline VertexLayout vertexLayout(VertexFormat format, VertexLayoutKind kind, size_t count)
+{
+	GLsizei pb = VertexFormatInfos[format].positionBytes, nb = VertexFormatInfos[format].normalBytes;
+	VertexLayout l;
+	l.format = format;
+	l.kind = kind;
+	l.count = count;
+	l.buffers = kind == StreamLayout ? 2 : 1;
+	l.bufferOffset[0] = 0;
+	l.bufferBytes[0] = kind == StreamLayout ? count * pb : count * (pb + nb);
+	l.bufferOffset[1] = count * pb;
+	l.bufferBytes[1] = count * nb;
+	VertexAttrib position = {0, 0, kind == InterleavedLayout ? pb + nb : pb};
+	VertexAttrib normal = {kind == StreamLayout ? 1 : 0, kind == SplitLayout ? count * pb : kind == InterleavedLayout ? size_t(pb) : 0,
+						   kind == InterleavedLayout ? pb + nb : nb};
+	l.position = position;
+	l.normal = normal;
+	return l;
+}
+
+// bind each buffer of the layout in turn and point the attributes into it
+inline void vertexAttribPointers(GLStateCache &gl, const VertexLayout &l, GLuint position, GLuint normal,
+								 const GLuint *buffers)
+{
+	const VertexFormatInfo &f = VertexFormatInfos[l.format];
+	gl.bindBuffer(GL_ARRAY_BUFFER, buffers[l.position.buffer]);
+	gl.attribPointer(position, f.positionSize, f.positionType, f.positionNormalized, l.position.stride,
+					 (const GLvoid *)l.position.offset);
+	gl.bindBuffer(GL_ARRAY_BUFFER, buffers[l.normal.buffer]);
+	gl.attribPointer(normal, f.normalSize, f.normalType, f.normalNormalized, l.normal.stride,
+					 (const GLvoid *)l.normal.offset);
+}
+
+// --- packing ---
+
+inline void encodePosition(VertexFormat format, const vec4 &p, char *out)
+{
+	if (format == FloatVertices)
+	{
+		memcpy(out, &p, sizeof(vec4));
+		return;
+	}
+	GLshort s[4] = {0, 0, 0, 0};
+	for (int k = 0; k < 3; k++)
+		s[k] = format == HalfVertices ? GLshort(halfFloat(p[k])) : snorm16(p[k]);
+	memcpy(out, s, sizeof(s));
+}
+
+inline void encodeNormal(VertexFormat format, const vec3 &n, char *out)
+{
+	if (format == FloatVertices)
+	{
+		memcpy(out, &n, sizeof(vec3));
+		return;
+	}
+	GLshort s[2];
+	octSnorm16(n, s);
+	memcpy(out, s, sizeof(s));
+}
+
+// write the vertices to out, which holds l.bytes() bytes
+inline void packVertices(const VertexLayout &l, const vec4 *points, const vec3 *normals, void *out, int threads = 1)
+{
+	char *data = (char *)out;
+	if (l.format == FloatVertices && l.kind != InterleavedLayout) // already laid out as the arrays are
+	{
+		memcpy(data + l.at(l.position, 0), points, l.count * sizeof(vec4));
+		memcpy(data + l.at(l.normal, 0), normals, l.count * sizeof(vec3));
+		return;
+	}
+	parallelForChunks(l.count, 4096, threads, [&](size_t i)
+					  {
+		encodePosition(l.format, points[i], data + l.at(l.position, i));
+		encodeNormal(l.format, normals[i], data + l.at(l.normal, i)); });
+}
+
+// position and normal of vertex i read back from packed vertices, as the vertex shader sees them
+inline void unpackVertex(const VertexLayout &l, const void *in, size_t i, vec4 &point, vec3 &normal)
+{
+	const char *data = (const char *)in;
+	if (l.format == FloatVertices)
+	{
+		memcpy(&point[0], data + l.at(l.position, i), sizeof(vec4));
+		memcpy(&normal[0], data + l.at(l.normal, i), sizeof(vec3));
+		return;
+	}
+	GLshort p[4], n[2];
+	memcpy(p, data + l.at(l.position, i), sizeof(p));
+	memcpy(n, data + l.at(l.normal, i), sizeof(n));
+	for (int k = 0; k < 3; k++)
+		point[k] = l.format == HalfVertices ? fromHalfFloat(GLushort(p[k])) : fromSnorm16(p[k]);
+	point.w = 1;
+	normal = octDecode(vec2(fromSnorm16(n[0]), fromSnorm16(n[1])));
+}
+
+struct VertexFormatError
+{
+	GLfloat position; // largest distance from the original position
+	GLfloat angle;	  // largest angle from the original normal, in degrees
+};
+
+// how far `count` vertices stored in `format` end up from the originals
+inline VertexFormatError vertexFormatError(VertexFormat format, const vec4 *points, const vec3 *normals, size_t count)
+{
+	VertexLayout l = vertexLayout(format, SplitLayout, count);
+	std::vector<char> packed(l.bytes());
+	packVertices(l, points, normals, &packed[0]);
+	VertexFormatError error = {0, 0};
+	for (size_t i = 0; i < count; i++)
+	{
+		vec4 p;
+		vec3 n;
+		unpackVertex(l, &packed[0], i, p, n);
+		vec4 d = p - points[i];
+		error.position = std::max(error.position, GLfloat(sqrt(d.x * d.x + d.y * d.y + d.z * d.z)));
+		error.angle = std::max(error.angle, GLfloat(normalAngle(n, normals[i]) * 180.0 / M_PI));
+	}
+	return error;
+}
@@ -1,26 +1,125 @@
 #version 130
+#extension GL_ARB_uniform_buffer_object : require
+// compiled once per variant, with these defined ahead of the source:
+//   DIRECTIONAL_LIGHT  the lights are unit directions rather than points
+//   SPECULAR           add the specular highlight
+//   NUM_LIGHTS         number of lights, 1 to 4
+//   IMPOSTOR           draw each sphere as a quad facing the viewer, which the fragment shader ray casts
+//   TILED_LIGHTS       the fragment shader adds the point lights binned into its screen tile
+//   BAKED              light the vertices of the unit sphere while Baking is set, for transform feedback to
+//                      keep; otherwise draw with the colors it kept
 
 in vec4 vPosition;
 in vec3 vNormal;
+in vec4 iOffsetScale; // per instance: center in xyz, radius in w; (0, 0, 0, 1) when not instanced
+in vec4 iColor; // per instance diffuse color; white when not instanced
+#ifdef BAKED
+in vec4 vBakedDiffuse; // diffuse light of the vertex, from the last bake
+in vec4 vBakedRest; // ambient and specular light of the vertex, from the last bake
+#endif
 
 out vec3 fN; // Normal vector
+#ifdef SPECULAR
 out vec3 fE; // View vector
-out vec3 fL; // Light vector
+#endif
+#ifndef DIRECTIONAL_LIGHT
+out vec3 fL[NUM_LIGHTS]; // Light vectors; a directional light is read straight from the block
+#endif
+out vec4 fDiffuse; // diffuse color of the instance
+#if defined(TILED_LIGHTS) && !defined(IMPOSTOR)
+out vec3 fEyePosition; // position in eye coordinates, where the tiled lights are
+#endif
+#ifdef BAKED
+out vec4 bakedDiffuse, bakedRest; // captured by the bake
+out vec4 fBaked; // color of the vertex
+#endif
+#ifdef IMPOSTOR
+out vec2 fCorner; // position on the quad, in units of the radius
+flat out vec4 fSphere; // center and radius in object coordinates
+flat out vec4 fEyeSphere; // center and radius in eye coordinates
+#endif
 
 uniform mat4 ModelView; // ModelView matrix
-uniform vec4 LightPosition; // Light position
+layout(std140) uniform Lighting { // light and material values, shared with the fragment shader
+    vec4 AmbientProduct, DiffuseProduct, SpecularProduct; // lighting products
+    vec4 LightPosition[4]; // Light positions, or unit directions for directional lights
+    float Shininess; // shininess exponent for the material
+};
 uniform mat4 Projection; // Projection matrix
+uniform bool OctahedralNormals; // vNormal.xy holds an octahedral encoded normal
+#ifdef BAKED
+uniform bool Baking; // light the vertices instead of drawing them
+#endif
 
+// unit normal from its octahedral encoding
+vec3 octDecode(vec2 p) {
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if(n.z < 0.0) // the lower half is folded over the diagonals
+        n.xy = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+#ifdef IMPOSTOR
+// the quad around the sphere, in the plane through its center facing the viewer; vPosition.xy is its corner,
+// from -1 to 1. The view is orthographic, so the quad covers the silhouette exactly
+void main() {
+    float radius = iOffsetScale.w * length(ModelView[0].xyz); // ModelView scales uniformly, if at all
+    vec3 center = (ModelView * vec4(iOffsetScale.xyz, 1.0)).xyz;
+    fCorner = vPosition.xy;
+    fSphere = iOffsetScale;
+    fEyeSphere = vec4(center, radius);
+    fDiffuse = iColor;
+    gl_Position = Projection * vec4(center + vec3(vPosition.xy * radius, 0.0), 1.0);
+}
+#elif defined(BAKED)
+// I = Ka * La + sum over the lights of Kd * Ld * max(N . L, 0) + Ks * Ls * max(N . H, 0)^Shininess, once per
+// vertex of the unit sphere, with the diffuse sum kept apart so that each instance can color it
 void main() {
-    fN = normalize(mat3(ModelView) * vNormal); // Normal vector in eye coordinates
-    vec4 eyePosition = ModelView * vPosition; // Vertex position in eye coordinates
+    if(Baking) {
+        vec3 N = normalize(mat3(ModelView) * (OctahedralNormals ? octDecode(vNormal.xy) : vNormal));
+        bakedDiffuse = vec4(0.0);
+        bakedRest = AmbientProduct;
+        for(int i = 0; i < NUM_LIGHTS; i++) {
+#ifdef DIRECTIONAL_LIGHT
+            vec3 L = LightPosition[i].xyz;
+#else
+            vec3 L = normalize(LightPosition[i].xyz - vPosition.xyz);
+#endif
+            bakedDiffuse += max(dot(L, N), 0.0) * DiffuseProduct;
+#ifdef SPECULAR
+            if(dot(L, N) >= 0.0) {
+                vec3 H = normalize(L + normalize(-(ModelView * vec4(vPosition.xyz, 1.0)).xyz));
+                bakedRest += pow(max(dot(N, H), 0.0), Shininess) * SpecularProduct;
+            }
+#endif
+        }
+        fBaked = vec4(0.0);
+        gl_Position = vec4(0.0, 0.0, 0.0, 1.0); // the rasterizer is off
+    } else {
+        bakedDiffuse = bakedRest = vec4(0.0);
+        fBaked = vec4((vBakedRest + vBakedDiffuse * iColor).rgb, 1.0);
+        gl_Position = Projection * (ModelView * vec4(vPosition.xyz * iOffsetScale.w + iOffsetScale.xyz, 1.0));
+    }
+}
+#else
+void main() {
+    vec3 normal = OctahedralNormals ? octDecode(vNormal.xy) : vNormal;
+    vec4 position = vec4(vPosition.xyz * iOffsetScale.w + iOffsetScale.xyz, 1.0); // place the unit sphere
+    fN = normalize(mat3(ModelView) * normal); // Normal vector in eye coordinates, unchanged by a uniform scale
+    vec4 eyePosition = ModelView * position; // Vertex position in eye coordinates
+    fDiffuse = iColor;
+#ifdef SPECULAR
     fE = -eyePosition.xyz; // View vector in eye coordinates
+#endif
+#ifdef TILED_LIGHTS
+    fEyePosition = eyePosition.xyz;
+#endif
 
-    if(LightPosition.w == 0.0) { // Directional light
-        fL = normalize(LightPosition.xyz); // Light vector in eye coordinates
-    } else { // Point light
-        fL = normalize(LightPosition.xyz - vPosition.xyz); // Light vector in eye coordinates
-    }
+#ifndef DIRECTIONAL_LIGHT // Point lights
+    for(int i = 0; i < NUM_LIGHTS; i++)
+        fL[i] = normalize(LightPosition[i].xyz - position.xyz); // Light vector in eye coordinates
+#endif
 
     gl_Position = Projection * eyePosition; // Vertex position in clip coordinates
 }
+#endif